@@ -108,6 +108,7 @@ extern dboolean         con_timestamps;
 extern int              episode;
 extern int              expansion;
 extern int              faceback;
+extern dboolean         fineblockmap;
 extern int              gametime;
 extern float            gp_deadzone_left;
 extern float            gp_deadzone_right;
@@ -189,6 +190,7 @@ extern unsigned int     stat_shotsfired;
 extern unsigned int     stat_shotshit;
 extern unsigned int     stat_time;
 extern int              stillbob;
+extern dboolean         threadedsight;
 extern dboolean         vid_capfps;
 extern int              vid_display;
 #if !defined(WIN32)
@@ -384,6 +386,7 @@ static dboolean kill_cmd_func1(char *, char *, char *, char *);
 static void kill_cmd_func2(char *, char *, char *, char *);
 static dboolean load_cmd_func1(char *, char *, char *, char *);
 static void load_cmd_func2(char *, char *, char *, char *);
+static void loadstats_cmd_func2(char *, char *, char *, char *);
 static dboolean map_cmd_func1(char *, char *, char *, char *);
 static void map_cmd_func2(char *, char *, char *, char *);
 static void maplist_cmd_func2(char *, char *, char *, char *);
@@ -400,6 +403,8 @@ static void save_cmd_func2(char *, char *, char *, char *);
 static dboolean spawn_cmd_func1(char *, char *, char *, char *);
 static void spawn_cmd_func2(char *, char *, char *, char *);
 static void thinglist_cmd_func2(char *, char *, char *, char *);
+static dboolean ticstats_cmd_func1(char *, char *, char *, char *);
+static void ticstats_cmd_func2(char *, char *, char *, char *);
 static void unbind_cmd_func2(char *, char *, char *, char *);
 
 static dboolean bool_cvars_func1(char *, char *, char *, char *);
@@ -414,6 +419,7 @@ static void time_cvars_func2(char *, char *, char *, char *);
 
 static void am_cheat_cvar_func2(char *, char *, char *, char *);
 static void am_external_cvar_func2(char *, char *, char *, char *);
+static void fineblockmap_cvar_func2(char *, char *, char *, char *);
 static dboolean gp_deadzone_cvars_func1(char *, char *, char *, char *);
 static void gp_deadzone_cvars_func2(char *, char *, char *, char *);
 static void gp_sensitivity_cvar_func2(char *, char *, char *, char *);
@@ -508,6 +514,7 @@ consolecmd_t consolecmds[] =
     CMD       (help, "", null_func1, help_cmd_func2, 0, "", "Shows the help screen."),
     CMD       (kill, "", kill_cmd_func1, kill_cmd_func2, 1, KILLCMDFORMAT, "Kills the player, all monsters or a type of monster."),
     CMD       (load, "", load_cmd_func1, load_cmd_func2, 1, "~filename~.save", "Loads a game from a file."),
+    CMD       (loadstats, "", game_func1, loadstats_cmd_func2, 0, "", "Shows how long each stage of loading the current map took."),
     CMD       (map, warp, map_cmd_func1, map_cmd_func2, 1, MAPCMDFORMAT, "Warps to a map."),
     CMD       (maplist, "", null_func1, maplist_cmd_func2, 0, "", "Shows a list of the available maps."),
     CMD       (mapstats, "", game_func1, mapstats_cmd_func2, 0, "", "Shows statistics about the current map."),
@@ -520,6 +527,7 @@ consolecmd_t consolecmds[] =
     CMD       (save, "", save_cmd_func1, save_cmd_func2, 1, "~filename~.save", "Saves the game to a file."),
     CMD       (spawn, summon, spawn_cmd_func1, spawn_cmd_func2, 1, SPAWNCMDFORMAT, "Spawns a monster or item."),
     CMD       (thinglist, "", game_func1, thinglist_cmd_func2, 0, "", "Shows a list of things in the current map."),
+    CMD       (ticstats, "", ticstats_cmd_func1, ticstats_cmd_func2, 1, "[on|off|reset]", "Toggles profiling of each tic, or shows the results."),
     CMD       (unbind, "", null_func1, unbind_cmd_func2, 1, "~control~", "Unbinds the action from a control."),
 
     // cheats
@@ -567,6 +575,7 @@ consolecmd_t consolecmds[] =
     CVAR_INT  (episode, "", int_cvars_func1, int_cvars_func2, CF_NONE, NOALIAS, "The currently selected ~DOOM~ episode in the menu."),
     CVAR_INT  (expansion, "", int_cvars_func1, int_cvars_func2, CF_NONE, NOALIAS, "The currently selected ~DOOM II~ expansion in the menu."),
     CVAR_INT  (faceback, "", int_cvars_func1, int_cvars_func2, CF_NONE, NOALIAS, "The color behind the player's face in the status bar."),
+    CVAR_BOOL (fineblockmap, "", bool_cvars_func1, fineblockmap_cvar_func2, "Toggles checking for lines in smaller blocks on maps with many\nlines in each block."),
     CVAR_TIME (gametime, "", null_func1, time_cvars_func2, "The amount of time since ~"PACKAGE_NAME"~ started."),
     CVAR_FLOAT(gp_deadzone_left, "", gp_deadzone_cvars_func1, gp_deadzone_cvars_func2, CF_PERCENT, "The dead zone of the gamepad's left thumbstick."),
     CVAR_FLOAT(gp_deadzone_right, "", gp_deadzone_cvars_func1, gp_deadzone_cvars_func2, CF_PERCENT, "The dead zone of the gamepad's right thumbstick."),
@@ -621,6 +630,7 @@ consolecmd_t consolecmds[] =
     CVAR_STR  (s_timiditycfgpath, "", null_func1, str_cvars_func2, "The path of Timidity's configuration file."),
     CVAR_INT  (skilllevel, "", int_cvars_func1, int_cvars_func2, CF_NONE, NOALIAS, "The currently selected skill level in the menu."),
     CVAR_INT  (stillbob, "", null_func1, int_cvars_func2, CF_PERCENT, NOALIAS, "The amount the player bobs when still."),
+    CVAR_BOOL (threadedsight, "", bool_cvars_func1, bool_cvars_func2, "Toggles checking if monsters can see their targets across all\nCPU cores at the start of each tic."),
     CVAR_BOOL (vid_capfps, "", bool_cvars_func1, bool_cvars_func2, "Toggles capping of the framerate at 35 FPS."),
     CVAR_INT  (vid_display, "", int_cvars_func1, vid_display_cvar_func2, CF_NONE, NOALIAS, "The display used to render the game."),
 #if !defined(WIN32)
@@ -1432,6 +1442,26 @@ static void load_cmd_func2(char *cmd, char *parm1, char *parm2, char *parm3)
         (M_StringEndsWith(parm1, ".save") ? "" : ".save"), NULL));
 }
 
+//
+// loadstats cmd
+//
+static void loadstats_cmd_func2(char *cmd, char *parm1, char *parm2, char *parm3)
+{
+    int         tabs[8] = { 160, 0, 0, 0, 0, 0, 0, 0 };
+    uint64_t    frequency = SDL_GetPerformanceFrequency();
+    int         i;
+
+    C_TabbedOutput(tabs, "~Stage~\t~Milliseconds~");
+
+    for (i = 0; loadstats[i].name[0]; ++i)
+    {
+        if (i == ls_total)
+            C_AddConsoleDivider();
+
+        C_TabbedOutput(tabs, "%s\t%.3f", loadstats[i].name, (double)loadstats[i].time * 1000.0 / frequency);
+    }
+}
+
 //
 // map cmd
 //
@@ -1580,7 +1610,7 @@ static void maplist_cmd_func2(char *cmd, char *parm1, char *parm2, char *parm3)
 
         M_StringCopy(wad, uppercase(leafname(lumpinfo[i]->wad_file->path)), MAX_PATH);
         replaced = (W_CheckMultipleLumps(lump) > 1 && !chex && !FREEDOOM);
-        pwad = (lumpinfo[i]->wad_file->type == PWAD);
+        pwad = (lumpinfo[i]->wad_file->type == PWAD || lumpinfo[i]->wad_file->type == PK3);
 
         switch (gamemission)
         {
@@ -2277,6 +2307,84 @@ static void thinglist_cmd_func2(char *cmd, char *parm1, char *parm2, char *parm3
     }
 }
 
+//
+// ticstats cmd
+//
+static dboolean ticstats_cmd_func1(char *cmd, char *parm1, char *parm2, char *parm3)
+{
+    return (!parm1[0] || M_StringCompare(parm1, "reset")
+        || C_LookupValueFromAlias(parm1, BOOLALIAS) >= 0);
+}
+
+static char *C_TicStatTime(uint64_t time, uint64_t frequency)
+{
+    static char buffer[4][16];
+    static int  i;
+
+    i = (i + 1) % 4;
+    M_snprintf(buffer[i], sizeof(buffer[i]), "%.3f", (double)time * 1000.0 / frequency);
+    return buffer[i];
+}
+
+static void ticstats_cmd_func2(char *cmd, char *parm1, char *parm2, char *parm3)
+{
+    int         tabs[8] = { 125, 180, 230, 280, 325, 370, 415, 460 };
+    uint64_t    frequency = SDL_GetPerformanceFrequency();
+    int         i;
+
+    if (parm1[0])
+    {
+        if (M_StringCompare(parm1, "reset"))
+            P_ResetTicStats();
+        else
+        {
+            int value = C_LookupValueFromAlias(parm1, BOOLALIAS);
+
+            if (value == 0)
+                ticstats = false;
+            else if (value == 1 && !ticstats)
+            {
+                ticstats = true;
+                P_ResetTicStats();
+            }
+        }
+        C_Output("Tic profiling is %s.", (ticstats ? "on" : "off"));
+        return;
+    }
+
+    if (!ticstattics)
+    {
+        C_Output("No tics have been profiled%s.", (ticstats ? "" : ". Enter \"ticstats on\" to start"));
+        return;
+    }
+
+    C_Output("%s tics profiled. Times are in milliseconds.", commify(ticstattics));
+    C_TabbedOutput(tabs, "\t~Per tic~\t~Average~\t~Maximum~\t~<%g~\t~<%g~\t~<%g~\t~<%g~\t~More~",
+        ticstatbuckets[0] / 1000.0, ticstatbuckets[1] / 1000.0, ticstatbuckets[2] / 1000.0,
+        ticstatbuckets[3] / 1000.0);
+
+    for (i = 0; ticstat[i].name[0]; ++i)
+    {
+        ticstat_t   *stat = &ticstat[i];
+        int         tics = 0;
+        int         j;
+
+        if (i == ts_total || i == ts_firstthinker)
+            C_AddConsoleDivider();
+
+        for (j = 0; j < TICSTATBUCKETS; ++j)
+            tics += stat->histogram[j];
+        if (!tics)
+            continue;
+
+        C_TabbedOutput(tabs, "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s", stat->name,
+            (i < ts_firstthinker && i != ts_runthinkers ? "-" : commify(stat->count / ticstattics)),
+            C_TicStatTime(stat->totaltime / ticstattics, frequency), C_TicStatTime(stat->maxtime, frequency),
+            commify(stat->histogram[0]), commify(stat->histogram[1]), commify(stat->histogram[2]),
+            commify(stat->histogram[3]), commify(stat->histogram[4]));
+    }
+}
+
 //
 // unbind cmd
 //
@@ -2561,6 +2669,16 @@ static void am_external_cvar_func2(char *cmd, char *parm1, char *parm2, char *pa
     }
 }
 
+//
+// fineblockmap cvar
+//
+static void fineblockmap_cvar_func2(char *cmd, char *parm1, char *parm2, char *parm3)
+{
+    bool_cvars_func2(cmd, parm1, "", "");
+    if (fineblockmap && gamestate == GS_LEVEL)
+        P_CreateFineBlockMap();
+}
+
 //
 // gp_deadzone_left and gp_deadzone_right cvars
 //
@@ -53,6 +53,7 @@
 #include "i_swap.h"
 #include "i_system.h"
 #include "i_timer.h"
+#include "i_tinttab.h"
 #include "i_video.h"
 #include "m_cheat.h"
 #include "m_menu.h"
@@ -139,7 +140,6 @@ extern dboolean alwaysrun;
 extern int      key_alwaysrun;
 
 void G_ToggleAlwaysRun(evtype_t type);
-int FindNearestColor(byte *palette, int red, int green, int blue);
 
 static const char *shiftxform =
 {
@@ -493,7 +493,6 @@ void C_Init(void)
 
     if (W_CheckMultipleLumps("STCFN065") > 1)
     {
-        byte    *playpal = W_CacheLumpName("PLAYPAL", PU_CACHE);
         int     red = 0, green = 0, blue = 0, total = 0;
 
         V_AverageColorInPatch(W_CacheLumpName("STCFN065", PU_STATIC), &red, &green, &blue, &total);
@@ -501,7 +500,7 @@ void C_Init(void)
         V_AverageColorInPatch(W_CacheLumpName("STCFN067", PU_STATIC), &red, &green, &blue, &total);
         if (total > 0)
         {
-            int color = FindNearestColor(playpal, red / total, green / total, blue / total);
+            int color = I_FindNearestColor(red / total, green / total, blue / total);
 
             if (color < 176 || color > 191)
                 consoleplayermessagecolor = color;
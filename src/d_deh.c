@@ -1788,7 +1788,8 @@ void ProcessDehFile(char *filename, int lumpnum)
         infile.inp = infile.lump = W_CacheLumpNum(lumpnum, PU_STATIC);
         filename = lumpinfo[lumpnum]->wad_file->path;
         C_Output("Parsed DEHACKED lump from %s file %s.",
-            (W_WadType(filename) == IWAD ? "IWAD" : "PWAD"), uppercase(filename));
+            (lumpinfo[lumpnum]->wad_file->type == IWAD ? "IWAD" :
+            (lumpinfo[lumpnum]->wad_file->type == PK3 ? "PK3" : "PWAD")), uppercase(filename));
     }
 
     {
@@ -64,7 +64,9 @@
 #include "i_gamepad.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_thread.h"
 #include "i_timer.h"
+#include "i_tinttab.h"
 #include "i_video.h"
 #include "m_argv.h"
 #include "m_config.h"
@@ -556,11 +558,24 @@ dboolean DehFileProcessed(char *path)
     return false;
 }
 
+static dboolean D_IsPK3File(char *filename)
+{
+    return (strlen(filename) > 4 && M_StringCompare(filename + strlen(filename) - 4, ".pk3"));
+}
+
+// Returns the path of a file with the same name as a PWAD or PK3 file, but
+// with the extension ext.
+static char *D_ChangeExtension(char *path, char *ext)
+{
+    return (D_IsPK3File(path) ? M_StringJoin(removeext(path), ext, NULL) :
+        M_StringReplace(path, ".wad", ext));
+}
+
 static void LoadDehFile(char *path)
 {
     if (!M_ParmExists("-nodeh") && !HasDehackedLump(path))
     {
-        char            *dehpath = M_StringReplace(path, ".wad", ".bex");
+        char            *dehpath = D_ChangeExtension(path, ".bex");
 
         if (M_FileExists(dehpath) && !DehFileProcessed(dehpath))
         {
@@ -572,7 +587,7 @@ static void LoadDehFile(char *path)
         }
         else
         {
-            char        *dehpath = M_StringReplace(path, ".wad", ".deh");
+            char        *dehpath = D_ChangeExtension(path, ".deh");
 
             if (M_FileExists(dehpath) && !DehFileProcessed(dehpath))
             {
@@ -586,7 +601,7 @@ static void LoadDehFile(char *path)
 
 static void LoadCfgFile(char *path)
 {
-    char        *cfgpath = M_StringReplace(path, ".wad", ".cfg");
+    char        *cfgpath = D_ChangeExtension(path, ".cfg");
 
     if (M_FileExists(cfgpath))
         M_LoadCVARs(cfgpath);
@@ -644,6 +659,14 @@ static void D_CheckSupportedPWAD(char *filename)
         BTSX = BTSXE3 = BTSXE3B = true;
 }
 
+// PK3 files are loaded the same way as PWADs
+static dboolean D_IsPWAD(char *filename)
+{
+    int type = W_WadType(filename);
+
+    return (type == PWAD || type == PK3);
+}
+
 static dboolean D_IsUnsupportedPWAD(char *filename)
 {
     return (M_StringCompare(leafname(filename), "VOICES.WAD"));
@@ -797,7 +820,7 @@ static int D_ChooseIWAD(void)
             }
 
             // if it's a PWAD, determine the IWAD required and try loading that as well
-            else if (W_WadType(file) == PWAD && !D_IsUnsupportedPWAD(file))
+            else if (D_IsPWAD(file) && !D_IsUnsupportedPWAD(file))
             {
                 int             iwadrequired = IWADRequiredByPWAD(file);
                 static char     fullpath[MAX_PATH];
@@ -1029,7 +1052,7 @@ static int D_ChooseIWAD(void)
                     char    *pwadpass1 = (char *)[[url lastPathComponent] UTF8String];
 #endif
 
-                    if (W_WadType(fullpath) == PWAD && !D_IsUnsupportedPWAD(fullpath)
+                    if (D_IsPWAD(fullpath) && !D_IsUnsupportedPWAD(fullpath)
                         && !D_IsDehFile(fullpath))
                     {
                         int     iwadrequired = IWADRequiredByPWAD(fullpath);
@@ -1120,7 +1143,7 @@ static int D_ChooseIWAD(void)
                     {
                         char    *fullpath = (char *)[url fileSystemRepresentation];
 #endif
-                        if (W_WadType(fullpath) == PWAD && !D_IsUnsupportedPWAD(fullpath)
+                        if (D_IsPWAD(fullpath) && !D_IsUnsupportedPWAD(fullpath)
                             && !D_IsDehFile(fullpath))
                         {
                             D_CheckSupportedPWAD(fullpath);
@@ -1247,11 +1270,32 @@ static void D_ProcessDehInWad(void)
             ProcessDehFile(NULL, i);
 }
 
+//
+// D_StartupPhase
+// Prints how long the phase of startup that just finished took when -devparm
+// is used.
+//
+static int      startupphasetimer;
+
+static void D_StartupPhase(char *phase)
+{
+    int now = I_GetTimeMS();
+
+    if (!startupphasetimer)
+        startupphasetimer = startuptimer;
+
+    if (devparm && startupphasetimer)
+        C_Output("%s took %ims.", phase, now - startupphasetimer);
+
+    startupphasetimer = now;
+}
+
 //
 // D_DoomMainSetup
 //
 // CPhipps - the old contents of D_DoomMain, but moved out of the main
 //  line of execution so its stack space can be freed
+//
 static void D_DoomMainSetup(void)
 {
     int         p;
@@ -1314,6 +1358,7 @@ static void D_DoomMainSetup(void)
     // init subsystems
     V_Init();
     I_InitTimer();
+    I_InitThreads();
 
     if (stat_runs < 2)
         C_Output("~"PACKAGE_NAME"~ has been run %s.", (!stat_runs ? "once" : "twice"));
@@ -1378,6 +1423,13 @@ static void D_DoomMainSetup(void)
     if (!W_MergeFile(packagewad, true))
         I_Error("%s can't be found.\nPlease reinstall "PACKAGE_NAME".", uppercase(packagewad));
 
+    W_MergeFiles();
+
+    // Generate the WAD hash table. Speed things up a bit.
+    W_GenerateHashTable();
+
+    D_StartupPhase("Loading WADs");
+
     if (!CheckPackageWADVersion())
         I_Error("The wrong version of %s was found.\nPlease reinstall "PACKAGE_NAME".",
             uppercase(packagewad));
@@ -1414,19 +1466,20 @@ static void D_DoomMainSetup(void)
 
     bfgedition = (DMENUPIC && W_CheckNumForName("M_ACPT") >= 0);
 
-    // Generate the WAD hash table. Speed things up a bit.
-    W_GenerateHashTable();
-
     D_IdentifyVersion();
     InitGameVersion();
     D_ProcessDehInWad();
     D_SetGameDescription();
     D_SetSaveGameFolder();
 
+    D_StartupPhase("Processing DeHackEd lumps");
+
     I_InitGamepad();
 
     I_InitGraphics();
 
+    D_StartupPhase("Initializing graphics");
+
     // Check for -file in shareware
     if (modifiedgame)
     {
@@ -1605,12 +1658,18 @@ static void D_DoomMainSetup(void)
 
     M_Init();
 
+    D_StartupPhase("Initializing menus");
+
     R_Init();
 
+    D_StartupPhase("Initializing renderer");
+
     P_Init();
 
     S_Init((int)(sfxVolume * 127.0f / 15.0f), (int)(musicVolume * 127.0f / 15.0f));
 
+    D_StartupPhase("Initializing sound");
+
     HU_Init();
 
     ST_Init();
@@ -1619,6 +1678,13 @@ static void D_DoomMainSetup(void)
 
     C_Init();
 
+    D_StartupPhase("Initializing HUD, status bar, automap and console");
+
+    // The tint tables have been generated in the background since I_InitGraphics()
+    I_WaitTintTables();
+
+    D_StartupPhase("Waiting for tint tables");
+
     if (startloadgame >= 0)
     {
         I_InitKeyboard();
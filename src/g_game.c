@@ -260,6 +260,12 @@ static int      dclicks2;
 static int      savegameslot;
 static char     savedescription[SAVESTRINGSIZE];
 
+// The savegame being written in the background, and how to announce it
+static dboolean savegamewriting;
+static char     savegamewritingname[256];
+static char     savegamewritingdescription[SAVESTRINGSIZE];
+static dboolean savegamewritingconsole;
+
 dboolean        loadedgame = false;
 
 extern dboolean alwaysrun;
@@ -891,6 +897,9 @@ void G_Ticker(void)
 
     P_MapEnd();
 
+    if (savegamewriting && P_SaveGameWritten())
+        G_FinishSaveGame();
+
     // do things to change the game state
     while (gameaction != ga_nothing)
     {
@@ -1015,6 +1024,7 @@ void G_Ticker(void)
             ST_Ticker();
             AM_Ticker();
             HU_Ticker();
+            R_PrecacheTic();
             break;
 
         case GS_INTERMISSION:
@@ -1414,16 +1424,15 @@ void G_DoLoadGame(void)
 
     gameaction = ga_nothing;
 
-    save_stream = fopen(savename, "rb");
+    // the savegame may still be being written
+    G_FinishSaveGame();
 
-    if (!save_stream)
+    if (!P_OpenSaveGameForReading(savename))
         return;
 
-    savegame_error = false;
-
     if (!P_ReadSaveGameHeader(savedescription))
     {
-        fclose(save_stream);
+        P_CloseSaveGame();
         return;
     }
 
@@ -1446,7 +1455,7 @@ void G_DoLoadGame(void)
     if (!P_ReadSaveGameEOF())
         I_Error("Bad savegame");
 
-    fclose(save_stream);
+    P_CloseSaveGame();
 
     if (setsizeneeded)
         R_ExecuteSetViewSize();
@@ -1499,16 +1508,15 @@ void G_DoSaveGame(void)
     char        *temp_savegame_file = P_TempSaveGameFile();
     char        *savegame_file = (consoleactive ? savename : P_SaveGameFile(savegameslot));
 
-    // Open the savegame file for writing. We write to a temporary file
-    // and then rename it at the end if it was successfully written.
-    // This prevents an existing savegame from being overwritten by
-    // a corrupted one, or if a savegame buffer overrun occurs.
-    save_stream = fopen(temp_savegame_file, "wb");
+    // only one savegame can be written at a time
+    G_FinishSaveGame();
 
-    if (!save_stream)
-        return;
-
-    savegame_error = false;
+    // The savegame is built up in memory, and then written to a temporary
+    // file in one go on a separate thread, which renames it at the end if
+    // it was successfully written. This prevents an existing savegame from
+    // being overwritten by a corrupted one, and the game from pausing while
+    // it's written.
+    P_OpenSaveGameForWriting();
 
     P_WriteSaveGameHeader(savedescription);
 
@@ -1520,32 +1528,48 @@ void G_DoSaveGame(void)
 
     P_WriteSaveGameEOF();
 
-    // Finish up, close the savegame file.
-    fclose(save_stream);
+    // Finish up, write the savegame file.
+    P_WriteSaveGameFile(temp_savegame_file, savegame_file);
 
-    // Now rename the temporary savegame file to the actual savegame
-    // file, overwriting the old savegame if there was one there.
-    remove(savegame_file);
-    rename(temp_savegame_file, savegame_file);
+    savegamewriting = true;
+    M_StringCopy(savegamewritingname, savegame_file, sizeof(savegamewritingname));
+    M_StringCopy(savegamewritingdescription, savedescription,
+        sizeof(savegamewritingdescription));
+    savegamewritingconsole = consoleactive;
 
-    if (consoleactive)
-        C_Output("%s saved.", uppercase(savename));
+    gameaction = ga_nothing;
+    M_StringCopy(savedescription, "", sizeof(savedescription));
+
+    // draw the pattern into the back screen
+    R_FillBackScreen();
+}
+
+//
+// G_FinishSaveGame
+// Waits for the savegame being written by G_DoSaveGame() if there is one, and
+// announces it.
+//
+void G_FinishSaveGame(void)
+{
+    if (!savegamewriting)
+        return;
+
+    savegamewriting = false;
+
+    if (!P_FinishSaveGame())
+        C_Warning("%s couldn't be saved.", uppercase(savegamewritingname));
+    else if (savegamewritingconsole)
+        C_Output("%s saved.", uppercase(savegamewritingname));
     else
     {
         static char     buffer[1024];
 
-        M_snprintf(buffer, sizeof(buffer), s_GGSAVED, titlecase(savedescription));
+        M_snprintf(buffer, sizeof(buffer), s_GGSAVED, titlecase(savegamewritingdescription));
         HU_PlayerMessage(buffer, false);
         message_dontfuckwithme = true;
         S_StartSound(NULL, sfx_swtchx);
     }
 
-    gameaction = ga_nothing;
-    M_StringCopy(savedescription, "", sizeof(savedescription));
-
-    // draw the pattern into the back screen
-    R_FillBackScreen();
-
     drawdisk = false;
 }
 
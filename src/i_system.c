@@ -230,6 +230,8 @@ void I_Quit(dboolean shutdown)
 {
     if (shutdown)
     {
+        G_FinishSaveGame();
+
         S_Shutdown();
 
         if (returntowidescreen)
@@ -0,0 +1,141 @@
+/*
+========================================================================
+
+                           D O O M  R e t r o
+         The classic, refined DOOM source port. For Windows PC.
+
+========================================================================
+
+  Copyright  1993-2012 id Software LLC, a ZeniMax Media company.
+  Copyright  2013-2016 Brad Harding.
+
+  DOOM Retro is a fork of Chocolate DOOM.
+  For a list of credits, see the accompanying AUTHORS file.
+
+  This file is part of DOOM Retro.
+
+  DOOM Retro is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation, either version 3 of the License, or (at your
+  option) any later version.
+
+  DOOM Retro is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with DOOM Retro. If not, see <http://www.gnu.org/licenses/>.
+
+  DOOM is a registered trademark of id Software LLC, a ZeniMax Media
+  company, in the US and/or other countries and is used without
+  permission. All other trademarks are the property of their respective
+  holders. DOOM Retro is in no way affiliated with nor endorsed by
+  id Software.
+
+========================================================================
+*/
+
+#include "i_thread.h"
+#include "m_fixed.h"
+#include "SDL.h"
+
+static int              numthreads = 1;
+
+static SDL_sem          *startsem;
+static SDL_sem          *donesem;
+
+static parallelfunc_t   jobfunc;
+static void             *jobdata;
+static int              jobcount;
+static int              jobchunksize;
+static SDL_atomic_t     jobnext;
+
+static void I_RunJob(int thread)
+{
+    int start;
+
+    while ((start = SDL_AtomicAdd(&jobnext, jobchunksize)) < jobcount)
+        jobfunc(start, MIN(start + jobchunksize, jobcount), thread, jobdata);
+}
+
+static int SDLCALL I_WorkerThread(void *data)
+{
+    int thread = (int)(intptr_t)data;
+
+    while (1)
+    {
+        SDL_SemWait(startsem);
+        I_RunJob(thread);
+        SDL_SemPost(donesem);
+    }
+
+    return 0;
+}
+
+//
+// I_InitThreads
+// Start a worker thread for each additional CPU core.
+//
+void I_InitThreads(void)
+{
+    int count = BETWEEN(1, SDL_GetCPUCount(), MAXTHREADS);
+
+    if (count == 1 || !(startsem = SDL_CreateSemaphore(0)) || !(donesem = SDL_CreateSemaphore(0)))
+        return;
+
+    while (numthreads < count)
+    {
+        SDL_Thread  *thread = SDL_CreateThread(I_WorkerThread, "worker",
+                        (void *)(intptr_t)numthreads);
+
+        if (!thread)
+            break;
+
+        SDL_DetachThread(thread);
+        ++numthreads;
+    }
+}
+
+//
+// I_GetNumThreads
+// Returns the number of threads a job is spread across, including the main thread.
+//
+int I_GetNumThreads(void)
+{
+    return numthreads;
+}
+
+//
+// I_ParallelFor
+// Calls func for every index from 0 to count - 1, in ranges of chunksize, spread
+// across all threads. Returns once all of them have finished. Must only be called
+// from the main thread.
+//
+void I_ParallelFor(int count, int chunksize, parallelfunc_t func, void *data)
+{
+    int i;
+
+    if (count <= 0)
+        return;
+
+    if (numthreads == 1 || count <= chunksize)
+    {
+        func(0, count, 0, data);
+        return;
+    }
+
+    jobfunc = func;
+    jobdata = data;
+    jobcount = count;
+    jobchunksize = chunksize;
+    SDL_AtomicSet(&jobnext, 0);
+
+    for (i = 1; i < numthreads; ++i)
+        SDL_SemPost(startsem);
+
+    I_RunJob(0);
+
+    for (i = 1; i < numthreads; ++i)
+        SDL_SemWait(donesem);
+}
@@ -36,12 +36,23 @@
 ========================================================================
 */
 
+#include "i_thread.h"
+#include "i_tinttab.h"
 #include "m_fixed.h"
+#include "m_misc.h"
+#include "SDL.h"
 #include "w_wad.h"
 #include "z_zone.h"
 
 #define ADDITIVE       -1
 
+#define TINTTABVERSION  1
+
+// The color cube divides RGB space into CUBESIZE cells along each axis
+#define CUBEBITS        5
+#define CUBESIZE        (1 << CUBEBITS)
+#define CELLBITS        (8 - CUBEBITS)
+
 #define R               1
 #define W               2
 #define G               4
@@ -128,9 +139,187 @@ int FindNearestColor(byte *palette, int red, int green, int blue)
     return best_color;
 }
 
-static byte *GenerateTintTable(byte *palette, int percent, byte filter[256], int colors)
+// The palette the color cube was built from
+static byte             cubepalette[768];
+
+// For each cell of the color cube, the palette indices of every color that
+// could be the nearest to a color inside it, in ascending order
+static int              *cubecells;
+static byte             *cubecolors;
+
+// The squared distances along each axis from each cell to each color, and
+// the smallest distance some color is within from every point in each cell
+static int              cubenearest[3][CUBESIZE][256];
+static int              cubefarthest[3][CUBESIZE][256];
+static int              *cubebounds;
+
+static void FindColorCubeCandidates(int start, int end, int thread, void *data)
+{
+    dboolean    counting = !data;
+    int         cell;
+
+    for (cell = start; cell < end; ++cell)
+    {
+        int     *nearestr = cubenearest[0][cell >> (CUBEBITS * 2)];
+        int     *nearestg = cubenearest[1][(cell >> CUBEBITS) & (CUBESIZE - 1)];
+        int     *nearestb = cubenearest[2][cell & (CUBESIZE - 1)];
+        int     i;
+
+        if (counting)
+        {
+            int *farthestr = cubefarthest[0][cell >> (CUBEBITS * 2)];
+            int *farthestg = cubefarthest[1][(cell >> CUBEBITS) & (CUBESIZE - 1)];
+            int *farthestb = cubefarthest[2][cell & (CUBESIZE - 1)];
+            int bound = INT_MAX;
+            int count = 0;
+
+            for (i = 0; i < 256; ++i)
+                bound = MIN(bound, farthestr[i] + farthestg[i] + farthestb[i]);
+
+            // any color that can come closer than that is a candidate
+            for (i = 0; i < 256; ++i)
+                count += (nearestr[i] + nearestg[i] + nearestb[i] <= bound);
+
+            cubebounds[cell] = bound;
+            cubecells[cell + 1] = count;
+        }
+        else
+        {
+            byte    *colors = cubecolors + cubecells[cell];
+
+            for (i = 0; i < 256; ++i)
+                if (nearestr[i] + nearestg[i] + nearestb[i] <= cubebounds[cell])
+                    *colors++ = i;
+        }
+    }
+}
+
+//
+// I_InitColorCube
+// Builds the color cube used by I_FindNearestColor() for palette. The cube
+// isn't changed again, so it can be used from any thread once this returns.
+//
+void I_InitColorCube(byte *palette)
+{
+    int i, j, k;
+
+    memcpy(cubepalette, palette, sizeof(cubepalette));
+
+    for (i = 0; i < 3; ++i)
+        for (j = 0; j < CUBESIZE; ++j)
+        {
+            int low = j << CELLBITS;
+            int high = low + (1 << CELLBITS) - 1;
+
+            for (k = 0; k < 256; ++k)
+            {
+                int value = palette[k * 3 + i];
+                int nearest = (value < low ? low - value : (value > high ? value - high : 0));
+                int farthest = MAX(ABS(value - low), ABS(value - high));
+
+                cubenearest[i][j][k] = nearest * nearest;
+                cubefarthest[i][j][k] = farthest * farthest;
+            }
+        }
+
+    free(cubecells);
+    free(cubecolors);
+    cubecells = malloc((CUBESIZE * CUBESIZE * CUBESIZE + 1) * sizeof(*cubecells));
+    cubebounds = malloc(CUBESIZE * CUBESIZE * CUBESIZE * sizeof(*cubebounds));
+
+    // count the candidates in each cell, then store them
+    cubecells[0] = 0;
+    I_ParallelFor(CUBESIZE * CUBESIZE * CUBESIZE, 256, FindColorCubeCandidates, NULL);
+
+    for (i = 0; i < CUBESIZE * CUBESIZE * CUBESIZE; ++i)
+        cubecells[i + 1] += cubecells[i];
+
+    cubecolors = malloc(cubecells[CUBESIZE * CUBESIZE * CUBESIZE]);
+    I_ParallelFor(CUBESIZE * CUBESIZE * CUBESIZE, 256, FindColorCubeCandidates, cubecolors);
+
+    free(cubebounds);
+    cubebounds = NULL;
+}
+
+//
+// I_FindNearestColor
+// Returns the same color as FindNearestColor() would for the palette passed to
+// I_InitColorCube(), but only compares the colors in the cell of the color cube
+// that the color is in.
+//
+int I_FindNearestColor(int red, int green, int blue)
+{
+    int cell;
+    int best_difference = INT_MAX;
+    int best_color = 0;
+    int i;
+
+    if ((red | green | blue) & ~255)
+        return FindNearestColor(cubepalette, red, green, blue);
+
+    cell = (((red >> CELLBITS) << (CUBEBITS * 2)) | ((green >> CELLBITS) << CUBEBITS)
+        | (blue >> CELLBITS));
+
+    for (i = cubecells[cell]; i < cubecells[cell + 1]; ++i)
+    {
+        byte    *color = cubepalette + cubecolors[i] * 3;
+        int     r = red - color[0];
+        int     g = green - color[1];
+        int     b = blue - color[2];
+        int     difference = r * r + g * g + b * b;
+
+        if (difference < best_difference)
+        {
+            if (!difference)
+                return cubecolors[i];
+
+            best_color = cubecolors[i];
+            best_difference = difference;
+        }
+    }
+
+    return best_color;
+}
+
+typedef struct
+{
+    byte        **table;
+    int         percent;
+    int         colors;
+} tinttabinfo_t;
+
+static tinttabinfo_t tinttabinfo[] =
+{
+    { &tinttab,           ADDITIVE, ALL                       },
+    { &tinttab20,         20,       ALL                       },
+    { &tinttab25,         25,       ALL                       },
+    { &tinttab33,         33,       ALL                       },
+    { &tinttab40,         40,       ALL                       },
+    { &tinttab50,         50,       ALL                       },
+    { &tinttab60,         60,       ALL                       },
+    { &tinttab66,         66,       ALL                       },
+    { &tinttab75,         75,       ALL                       },
+    { &tinttab80,         80,       ALL                       },
+    { &tinttabred,        ADDITIVE, REDS                      },
+    { &tinttabredwhite1,  ADDITIVE, (REDS | WHITES)           },
+    { &tinttabredwhite2,  ADDITIVE, (REDS | WHITES | EXTRAS)  },
+    { &tinttabgreen,      ADDITIVE, GREENS                    },
+    { &tinttabblue,       ADDITIVE, BLUES                     },
+    { &tinttabred33,      33,       REDS                      },
+    { &tinttabredwhite50, 50,       (REDS | WHITES)           },
+    { &tinttabgreen33,    33,       GREENS                    },
+    { &tinttabblue33,     33,       BLUES                     }
+};
+
+#define NUMTINTTABS     (int)arrlen(tinttabinfo)
+
+static byte             tintpalette[768];
+static SDL_Thread       *tinttabthread;
+static char             *tinttabfilename;
+
+static void GenerateTintTable(byte *result, byte *palette, int percent, byte filter[256],
+    int colors)
 {
-    byte        *result = Z_Malloc(65536, PU_STATIC, NULL);
     int         foreground, background;
 
     for (foreground = 0; foreground < 256; ++foreground)
@@ -164,44 +353,118 @@ static byte *GenerateTintTable(byte *palette, int percent, byte filter[256], int
                     g = ((int)color1[1] * percent + (int)color2[1] * (100 - percent)) / 100;
                     b = ((int)color1[2] * percent + (int)color2[2] * (100 - percent)) / 100;
                 }
-                *(result + (background << 8) + foreground) = FindNearestColor(palette, r, g, b);
+                *(result + (background << 8) + foreground) = I_FindNearestColor(r, g, b);
             }
         }
         else
             for (background = 0; background < 256; ++background)
                 *(result + (background << 8) + foreground) = foreground;
     }
+}
+
+static dboolean LoadTintTables(void)
+{
+    FILE        *file = fopen(tinttabfilename, "rb");
+    dboolean    result = !!file;
+    int         i;
 
+    if (!file)
+        return false;
+
+    for (i = 0; i < NUMTINTTABS && result; ++i)
+        result = (fread(*tinttabinfo[i].table, 1, 65536, file) == 65536);
+
+    fclose(file);
     return result;
 }
 
-void I_InitTintTables(byte *palette)
+static void SaveTintTables(void)
+{
+    FILE        *file = fopen(tinttabfilename, "wb");
+    int         i;
+
+    if (file)
+    {
+        for (i = 0; i < NUMTINTTABS; ++i)
+            fwrite(*tinttabinfo[i].table, 1, 65536, file);
+
+        fclose(file);
+    }
+}
+
+static int SDLCALL GenerateTintTables(void *data)
 {
-    int lump;
+    int i;
+
+    // use the tables generated the last time this palette was used if there are any
+    if (!LoadTintTables())
+    {
+        for (i = 0; i < NUMTINTTABS; ++i)
+            GenerateTintTable(*tinttabinfo[i].table, tintpalette, tinttabinfo[i].percent,
+                general, tinttabinfo[i].colors);
+
+        SaveTintTables();
+    }
 
-    tinttab = GenerateTintTable(palette, ADDITIVE, general, ALL);
+    return 0;
+}
+
+//
+// I_InitTintTables
+// Allocates the tint tables and starts filling them in on a separate thread,
+// so the rest of startup can carry on in the meantime. I_WaitTintTables() must
+// be called before any of them are used.
+//
+void I_InitTintTables(byte *palette)
+{
+    int         lump;
+    int         i;
+    int         version = TINTTABVERSION;
+    uint64_t    hash = HASHBASIS;
+    char        *folder;
+    char        name[32];
 
-    tinttab20 = GenerateTintTable(palette, 20, general, ALL);
-    tinttab25 = GenerateTintTable(palette, 25, general, ALL);
-    tinttab33 = GenerateTintTable(palette, 33, general, ALL);
-    tinttab40 = GenerateTintTable(palette, 40, general, ALL);
-    tinttab50 = GenerateTintTable(palette, 50, general, ALL);
-    tinttab60 = GenerateTintTable(palette, 60, general, ALL);
-    tinttab66 = GenerateTintTable(palette, 66, general, ALL);
-    tinttab75 = GenerateTintTable(palette, 75, general, ALL);
-    tinttab80 = GenerateTintTable(palette, 80, general, ALL);
+    // the zone memory allocator isn't thread-safe, so allocate all of the tables here
+    for (i = 0; i < NUMTINTTABS; ++i)
+        *tinttabinfo[i].table = Z_Malloc(65536, PU_STATIC, NULL);
 
     tranmap = ((lump = W_CheckNumForName("TRANMAP")) != -1 ? W_CacheLumpNum(lump, PU_STATIC) :
         tinttab50);
 
-    tinttabred = GenerateTintTable(palette, ADDITIVE, general, REDS);
-    tinttabredwhite1 = GenerateTintTable(palette, ADDITIVE, general, (REDS | WHITES));
-    tinttabredwhite2 = GenerateTintTable(palette, ADDITIVE, general, (REDS | WHITES | EXTRAS));
-    tinttabgreen = GenerateTintTable(palette, ADDITIVE, general, GREENS);
-    tinttabblue = GenerateTintTable(palette, ADDITIVE, general, BLUES);
+    // the palette lump may be purged before the thread is done with it
+    memcpy(tintpalette, palette, sizeof(tintpalette));
+
+    // the tables are cached in a file named after everything they're generated from
+    hash = hashbytes(hash, &version, sizeof(version));
+    hash = hashbytes(hash, tintpalette, sizeof(tintpalette));
+    hash = hashbytes(hash, general, sizeof(general));
+
+    for (i = 0; i < NUMTINTTABS; ++i)
+    {
+        hash = hashbytes(hash, &tinttabinfo[i].percent, sizeof(tinttabinfo[i].percent));
+        hash = hashbytes(hash, &tinttabinfo[i].colors, sizeof(tinttabinfo[i].colors));
+    }
+
+    folder = M_StringJoin(M_GetAppDataFolder(), DIR_SEPARATOR_S, "tinttabs", NULL);
+    M_MakeDirectory(folder);
+    M_snprintf(name, sizeof(name), "%016llx.tinttabs", (unsigned long long)hash);
+    free(tinttabfilename);
+    tinttabfilename = M_StringJoin(folder, DIR_SEPARATOR_S, name, NULL);
+    free(folder);
+
+    if (!(tinttabthread = SDL_CreateThread(GenerateTintTables, "tinttabs", NULL)))
+        GenerateTintTables(NULL);
+}
 
-    tinttabred33 = GenerateTintTable(palette, 33, general, REDS);
-    tinttabredwhite50 = GenerateTintTable(palette, 50, general, (REDS | WHITES));
-    tinttabgreen33 = GenerateTintTable(palette, 33, general, GREENS);
-    tinttabblue33 = GenerateTintTable(palette, 33, general, BLUES);
+//
+// I_WaitTintTables
+// Returns once all of the tint tables have been generated.
+//
+void I_WaitTintTables(void)
+{
+    if (tinttabthread)
+    {
+        SDL_WaitThread(tinttabthread, NULL);
+        tinttabthread = NULL;
+    }
 }
@@ -39,6 +39,14 @@
 #if !defined(__I_TINTTAB__)
 #define __I_TINTTAB__
 
+#include "doomtype.h"
+
+int FindNearestColor(byte *palette, int red, int green, int blue);
+
+void I_InitColorCube(byte *palette);
+int I_FindNearestColor(int red, int green, int blue);
+
 void I_InitTintTables(byte *palette);
+void I_WaitTintTables(void);
 
 #endif
@@ -1480,6 +1480,7 @@ void I_InitGraphics(void)
     keys['a'] = keys['A'] = false;
     keys['l'] = keys['L'] = false;
 
+    I_InitColorCube(doompal);
     I_InitTintTables(doompal);
 
     I_InitGammaTables();
@@ -80,6 +80,7 @@ extern dboolean         con_timestamps;
 extern int              episode;
 extern int              expansion;
 extern int              faceback;
+extern dboolean         fineblockmap;
 extern float            gp_deadzone_left;
 extern float            gp_deadzone_right;
 extern int              gp_sensitivity;
@@ -160,6 +161,7 @@ extern unsigned int     stat_secretsrevealed;
 extern unsigned int     stat_shotsfired;
 extern unsigned int     stat_shotshit;
 extern unsigned int     stat_time;
+extern dboolean         threadedsight;
 extern dboolean         vid_capfps;
 extern int              vid_display;
 #if !defined(WIN32)
@@ -217,6 +219,7 @@ static default_t cvars[] =
     CONFIG_VARIABLE_INT          (episode,                               NOALIAS    ),
     CONFIG_VARIABLE_INT          (expansion,                             NOALIAS    ),
     CONFIG_VARIABLE_INT          (faceback,                              NOALIAS    ),
+    CONFIG_VARIABLE_INT          (fineblockmap,                          BOOLALIAS  ),
     CONFIG_VARIABLE_FLOAT_PERCENT(gp_deadzone_left,                      NOALIAS    ),
     CONFIG_VARIABLE_FLOAT_PERCENT(gp_deadzone_right,                     NOALIAS    ),
     CONFIG_VARIABLE_INT          (gp_sensitivity,                        NOALIAS    ),
@@ -298,6 +301,7 @@ static default_t cvars[] =
     CONFIG_VARIABLE_INT_UNSIGNED (stat_shotshit,                         NOALIAS    ),
     CONFIG_VARIABLE_INT_UNSIGNED (stat_time,                             NOALIAS    ),
     CONFIG_VARIABLE_INT_PERCENT  (stillbob,                              NOALIAS    ),
+    CONFIG_VARIABLE_INT          (threadedsight,                         BOOLALIAS  ),
     CONFIG_VARIABLE_INT          (vid_capfps,                            BOOLALIAS  ),
     CONFIG_VARIABLE_INT          (vid_display,                           NOALIAS    ),
 #if !defined(WIN32)
@@ -603,6 +607,9 @@ static void M_CheckCVARs(void)
 
     faceback = BETWEEN(faceback_min, faceback, faceback_max);
 
+    if (fineblockmap != false && fineblockmap != true)
+        fineblockmap = fineblockmap_default;
+
     gp_deadzone_left = BETWEENF(gp_deadzone_left_min, gp_deadzone_left, gp_deadzone_left_max);
     gamepadleftdeadzone = (int)(gp_deadzone_left * (float)SHRT_MAX / 100.0f);
 
@@ -742,6 +749,9 @@ static void M_CheckCVARs(void)
 
     stillbob = BETWEEN(stillbob_min, stillbob, stillbob_max);
 
+    if (threadedsight != false && threadedsight != true)
+        threadedsight = threadedsight_default;
+
     if (vid_capfps != false && vid_capfps != true)
         vid_capfps = vid_capfps_default;
 
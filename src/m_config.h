@@ -143,6 +143,8 @@ typedef enum
 #define faceback_default                        5
 #define faceback_max                            255
 
+#define fineblockmap_default                    false
+
 #define expansion_min                           0
 #define expansion_default                       0
 #define expansion_max                           1
@@ -291,6 +293,8 @@ typedef enum
 #define stillbob_default                        0
 #define stillbob_max                            100
 
+#define threadedsight_default                   false
+
 #define vid_capfps_default                      false
 
 #define vid_display_min                         1
@@ -813,6 +813,9 @@ void M_ReadSaveStrings(void)
     int         i;
     char        name[256];
 
+    // the savegame may still be being written
+    G_FinishSaveGame();
+
     for (i = 0; i < load_end; i++)
     {
         FILE    *handle;
@@ -713,3 +713,16 @@ char *convertsize(const int size)
 
     return result;
 }
+
+// 64-bit FNV-1a hash. Start with HASHBASIS, and pass the result of the
+// previous call to hash more data.
+uint64_t hashbytes(uint64_t hash, const void *data, size_t size)
+{
+    const byte  *bytes = data;
+    size_t      i;
+
+    for (i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+
+    return hash;
+}
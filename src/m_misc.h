@@ -90,4 +90,8 @@ char *removeext(const char *file);
 dboolean isvowel(const char ch);
 char *convertsize(const int size);
 
+#define HASHBASIS       0xCBF29CE484222325ull
+
+uint64_t hashbytes(uint64_t hash, const void *data, size_t size);
+
 #endif
@@ -48,6 +48,7 @@
 #include "p_local.h"
 #include "p_tick.h"
 #include "s_sound.h"
+#include "z_zone.h"
 
 typedef enum
 {
@@ -78,44 +79,135 @@ extern int      stat_monsterskilled;
 //
 
 //
-// P_RecursiveSound
-// Called by P_NoiseAlert.
-// Recursively traverse adjacent sectors,
-// sound blocking lines cut off traversal.
+// Sound propagation
+// Each sector's two-sided lines are stored with the sector on their other
+// side at the start of each map, so a noise can be flooded through them
+// breadth-first instead of recursing through sec->lines.
+//
+typedef struct
+{
+    sector_t    *other;
+    dboolean    soundblock;
+} soundedge_t;
+
+static soundedge_t      *soundedges;
+static int              *firstsoundedge;        // into soundedges, for each sector
+static int              *soundqueue;
+
 //
-// killough 5/5/98: reformatted, cleaned up
+// P_InitSoundGraph
+// Called by P_SetupLevel() once the lines of each sector are known.
 //
-static void P_RecursiveSound(sector_t *sec, int soundblocks, mobj_t *soundtarget)
+void P_InitSoundGraph(void)
 {
-    int i;
+    int numedges = 0;
+    int i, j;
+
+    firstsoundedge = Z_Malloc((numsectors + 1) * sizeof(*firstsoundedge), PU_LEVEL, NULL);
+
+    for (i = 0; i < numsectors; ++i)
+    {
+        sector_t    *sec = &sectors[i];
+
+        firstsoundedge[i] = numedges;
+
+        for (j = 0; j < sec->linecount; ++j)
+        {
+            line_t  *check = sec->lines[j];
+
+            if ((check->flags & ML_TWOSIDED) && check->sidenum[1] != NO_INDEX)
+                ++numedges;
+        }
+    }
+
+    firstsoundedge[numsectors] = numedges;
+    soundedges = Z_Malloc(MAX(1, numedges) * sizeof(*soundedges), PU_LEVEL, NULL);
 
-    // wake up all monsters in this sector
-    if (sec->validcount == validcount && sec->soundtraversed <= soundblocks + 1)
-        return;         // already flooded
+    for (i = 0, numedges = 0; i < numsectors; ++i)
+    {
+        sector_t    *sec = &sectors[i];
+
+        for (j = 0; j < sec->linecount; ++j)
+        {
+            line_t  *check = sec->lines[j];
+
+            if ((check->flags & ML_TWOSIDED) && check->sidenum[1] != NO_INDEX)
+            {
+                soundedges[numedges].other = sides[check->sidenum[(sides[check->sidenum[0]].sector == sec)]].sector;
+                soundedges[numedges++].soundblock = !!(check->flags & ML_SOUNDBLOCK);
+            }
+        }
+    }
+
+    // a sector can be queued twice: once through a sound blocking line, and
+    // again when found without one
+    soundqueue = Z_Malloc((numsectors * 2 + 1) * sizeof(*soundqueue), PU_LEVEL, NULL);
+}
+
+//
+// P_FloodSound
+// Called by P_NoiseAlert.
+// Traverse adjacent sectors breadth-first, with sectors reached without
+// crossing a sound blocking line before those that were. Sound can't cross
+// a second sound blocking line. Reaches the same sectors with the same
+// soundtraversed as the original recursive traversal.
+//
+static void P_FloodSound(sector_t *sec, mobj_t *soundtarget)
+{
+    int size = numsectors * 2 + 1;
+    int head = 0;
+    int tail = 0;
 
     sec->validcount = validcount;
-    sec->soundtraversed = soundblocks + 1;
+    sec->soundtraversed = 1;
     P_SetTarget(&sec->soundtarget, soundtarget);
+    soundqueue[tail++] = sec - sectors;
 
-    for (i = 0; i < sec->linecount; i++)
+    while (head != tail)
     {
-        sector_t        *other;
-        line_t          *check = sec->lines[i];
+        int         secnum = soundqueue[head];
+        int         soundblocks;
+        int         i;
 
-        if (!(check->flags & ML_TWOSIDED))
-            continue;
+        head = (head + 1) % size;
+        sec = &sectors[secnum];
+        soundblocks = sec->soundtraversed - 1;
+
+        for (i = firstsoundedge[secnum]; i < firstsoundedge[secnum + 1]; ++i)
+        {
+            sector_t    *other = soundedges[i].other;
+            int         blocks = soundblocks + soundedges[i].soundblock;
 
-        P_LineOpening(check);
+            if (blocks > 1)
+                continue;
 
-        if (openrange <= 0)
-            continue;   // closed door
+            // already flooded
+            if (other->validcount == validcount && other->soundtraversed <= blocks + 1)
+                continue;
 
-        other = sides[check->sidenum[(sides[check->sidenum[0]].sector == sec)]].sector;
+            // closed door
+            if (MIN(sec->ceilingheight, other->ceilingheight) <= MAX(sec->floorheight, other->floorheight))
+                continue;
 
-        if (!(check->flags & ML_SOUNDBLOCK))
-            P_RecursiveSound(other, soundblocks, soundtarget);
-        else if (!soundblocks)
-            P_RecursiveSound(other, 1, soundtarget);
+            if (other->validcount != validcount)
+            {
+                other->validcount = validcount;
+                P_SetTarget(&other->soundtarget, soundtarget);
+            }
+
+            other->soundtraversed = blocks + 1;
+
+            if (blocks == soundblocks)
+            {
+                head = (head + size - 1) % size;
+                soundqueue[head] = other - sectors;
+            }
+            else
+            {
+                soundqueue[tail] = other - sectors;
+                tail = (tail + 1) % size;
+            }
+        }
     }
 }
 
@@ -131,7 +223,7 @@ void P_NoiseAlert(mobj_t *target, mobj_t *emmiter)
         return;
 
     ++validcount;
-    P_RecursiveSound(emmiter->subsector->sector, 0, target);
+    P_FloodSound(emmiter->subsector->sector, target);
 }
 
 //
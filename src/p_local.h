@@ -144,6 +144,7 @@ void P_SpawnPlayerMissile(mobj_t *source, mobjtype_t type);
 // P_ENEMY
 //
 void P_NoiseAlert(mobj_t *target, mobj_t *emmiter);
+void P_InitSoundGraph(void);
 
 //
 // P_MAPUTL
@@ -181,6 +182,8 @@ extern fixed_t          lowfloor;
 void P_LineOpening(line_t *linedef);
 
 dboolean P_BlockLinesIterator(int x, int y, dboolean func(line_t *));
+dboolean P_BoxLinesIteratorData(const fixed_t *bbox, dboolean func(line_t *, void *), void *data,
+    int *validcounts, int valid);
 dboolean P_BlockThingsIterator(int x, int y, dboolean func(mobj_t *));
 
 #define PT_ADDLINES     1
@@ -213,16 +216,46 @@ extern line_t           *blockline;
 
 extern dboolean         infight;
 
+// a move checked against the lines around it by P_CheckPositionLines()
+typedef struct
+{
+    // in
+    int         *validcounts;   // if NULL, lines' own validcount is used
+    int         validcount;
+
+    // in and out
+    fixed_t     floorz;
+    fixed_t     ceilingz;
+    fixed_t     dropoffz;
+    line_t      **spechit;      // reallocated if more room is needed
+    int         maxspechit;
+
+    // set from the thing and where it is moving to
+    mobj_t      *thing;
+    fixed_t     x;
+    fixed_t     y;
+    fixed_t     bbox[4];
+    dboolean    unstuck;
+
+    // out
+    line_t      *ceilingline;
+    line_t      *floorline;
+    line_t      *blockline;
+    int         numspechit;
+} lineclip_t;
+
 dboolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y);
+dboolean P_CheckPositionLines(mobj_t *thing, fixed_t x, fixed_t y, lineclip_t *clip);
 mobj_t *P_CheckOnmobj(mobj_t *thing);
 void P_FakeZMovement(mobj_t *mo);
 dboolean P_TryMove(mobj_t *thing, fixed_t x, fixed_t y, dboolean dropoff);
 dboolean P_CheckLineSide(mobj_t *actor, fixed_t x, fixed_t y);
 dboolean P_TeleportMove(mobj_t *thing, fixed_t x, fixed_t y, fixed_t z, dboolean boss);
 void P_SlideMove(mobj_t *mo);
-dboolean P_CheckSight(mobj_t *t1, mobj_t *t2);
 void P_UseLines(player_t *player);
 
+extern int              sectorchanges;  // incremented whenever a sector changes height
+
 dboolean P_ChangeSector(sector_t *sector, dboolean crunch);
 void P_FreeSecNodeList(void);
 
@@ -240,6 +273,16 @@ void P_ApplyTorque(mobj_t *mo);                         // killough 9/12/98
 
 void P_MapEnd(void);
 
+//
+// P_SIGHT
+//
+extern dboolean         threadedsight;
+
+dboolean P_CheckSight(mobj_t *t1, mobj_t *t2);
+void P_CheckSightBatch(mobj_t **things, int count, mobj_t *target, dboolean *visible);
+void P_PrecomputeSight(void);
+void P_InitSight(void);
+
 //
 // P_SETUP
 //
@@ -251,6 +294,12 @@ extern int              bmapheight;     // in mapblocks
 extern fixed_t          bmaporgx;
 extern fixed_t          bmaporgy;       // origin of block map
 extern mobj_t           **blocklinks;   // for thing chains
+extern int              fineblockshift;
+extern int              fineblockwidth;
+extern int              fineblockheight;
+extern int              *fineblockoffsets;
+extern int              *fineblocklines;
+extern dboolean         fineblockmap;
 
 //
 // P_INTER
@@ -91,6 +91,8 @@ dboolean        infight;
 
 mobj_t          *onmobj;
 
+int             sectorchanges;
+
 extern dboolean successfulshot;
 extern dboolean stat_shotshit;
 
@@ -332,32 +334,41 @@ static dboolean PIT_CrossLine(line_t *ld)
 
 // killough 8/1/98: used to test intersection between thing and line
 // assuming NO movement occurs -- used to avoid sticky situations.
-static int untouched(line_t *ld)
+static int untouched(mobj_t *thing, line_t *ld)
 {
     fixed_t     x, y;
     fixed_t     tmbbox[4];
-    fixed_t     tmradius = tmthing->radius;
+    fixed_t     tmradius = thing->radius;
 
-    return ((tmbbox[BOXRIGHT] = (x = tmthing->x) + tmradius) <= ld->bbox[BOXLEFT]
+    return ((tmbbox[BOXRIGHT] = (x = thing->x) + tmradius) <= ld->bbox[BOXLEFT]
         || (tmbbox[BOXLEFT] = x - tmradius) >= ld->bbox[BOXRIGHT]
-        || (tmbbox[BOXTOP] = (y = tmthing->y) + tmradius) <= ld->bbox[BOXBOTTOM]
+        || (tmbbox[BOXTOP] = (y = thing->y) + tmradius) <= ld->bbox[BOXBOTTOM]
         || (tmbbox[BOXBOTTOM] = y - tmradius) >= ld->bbox[BOXTOP]
         || P_BoxOnLineSide(tmbbox, ld) != -1);
 }
 
 //
 // PIT_CheckLine
-// Adjusts tmfloorz and tmceilingz as lines are contacted
+// Adjusts clip->floorz and clip->ceilingz as lines are contacted. Only the
+// lineclip_t passed to it is modified.
 //
-static dboolean PIT_CheckLine(line_t *ld)
+static dboolean PIT_CheckLine(line_t *ld, void *data)
 {
-    if (tmbbox[BOXRIGHT] <= ld->bbox[BOXLEFT]
-        || tmbbox[BOXLEFT] >= ld->bbox[BOXRIGHT]
-        || tmbbox[BOXTOP] <= ld->bbox[BOXBOTTOM]
-        || tmbbox[BOXBOTTOM] >= ld->bbox[BOXTOP])
+    lineclip_t  *clip = data;
+    mobj_t      *thing = clip->thing;
+    sector_t    *front;
+    sector_t    *back;
+    fixed_t     top;
+    fixed_t     bottom;
+    fixed_t     low;
+
+    if (clip->bbox[BOXRIGHT] <= ld->bbox[BOXLEFT]
+        || clip->bbox[BOXLEFT] >= ld->bbox[BOXRIGHT]
+        || clip->bbox[BOXTOP] <= ld->bbox[BOXBOTTOM]
+        || clip->bbox[BOXBOTTOM] >= ld->bbox[BOXTOP])
         return true;                                    // didn't hit it
 
-    if (P_BoxOnLineSide(tmbbox, ld) != -1)
+    if (P_BoxOnLineSide(clip->bbox, ld) != -1)
         return true;                                    // didn't hit it
 
     // A line has been hit
@@ -373,58 +384,104 @@ static dboolean PIT_CheckLine(line_t *ld)
     // killough 7/24/98: allow player to move out of 1s wall, to prevent sticking
     if (!ld->backsector)                                // one sided line
     {
-        blockline = ld;
-        return (tmunstuck && !untouched(ld)
-            && FixedMul(tmx - tmthing->x, ld->dy) > FixedMul(tmy - tmthing->y, ld->dx));
+        clip->blockline = ld;
+        return (clip->unstuck && !untouched(thing, ld)
+            && FixedMul(clip->x - thing->x, ld->dy) > FixedMul(clip->y - thing->y, ld->dx));
     }
 
-    if (!(tmthing->flags & MF_MISSILE))
+    if (!(thing->flags & MF_MISSILE))
     {
         if (ld->flags & ML_BLOCKING)                    // explicitly blocking everything
-            return (tmunstuck && !untouched(ld));       // killough 8/1/98: allow escape
+            return (clip->unstuck && !untouched(thing, ld));    // killough 8/1/98: allow escape
 
         // [BH] monster-blockers don't affect corpses
-        if (!tmthing->player && !(tmthing->flags & MF_CORPSE) && (ld->flags & ML_BLOCKMONSTERS))
+        if (!thing->player && !(thing->flags & MF_CORPSE) && (ld->flags & ML_BLOCKMONSTERS))
             return false;                               // block monsters only
     }
 
-    // set openrange, opentop, openbottom
-    // these define a 'window' from one sector to another across this line
-    P_LineOpening(ld);
+    // the 'window' from one sector to another across this line, as in
+    // P_LineOpening() but without setting its globals
+    front = ld->frontsector;
+    back = ld->backsector;
+    top = MIN(front->ceilingheight, back->ceilingheight);
+
+    if (front->floorheight > back->floorheight)
+    {
+        bottom = front->floorheight;
+        low = back->floorheight;
+    }
+    else
+    {
+        bottom = back->floorheight;
+        low = front->floorheight;
+    }
 
     // adjust floor / ceiling heights
-    if (opentop < tmceilingz)
+    if (top < clip->ceilingz)
     {
-        tmceilingz = opentop;
-        ceilingline = ld;
-        blockline = ld;
+        clip->ceilingz = top;
+        clip->ceilingline = ld;
+        clip->blockline = ld;
     }
 
-    if (openbottom > tmfloorz)
+    if (bottom > clip->floorz)
     {
-        tmfloorz = openbottom;
-        floorline = ld;                                 // killough 8/1/98: remember floor linedef
-        blockline = ld;
+        clip->floorz = bottom;
+        clip->floorline = ld;                           // killough 8/1/98: remember floor linedef
+        clip->blockline = ld;
     }
 
-    if (lowfloor < tmdropoffz)
-        tmdropoffz = lowfloor;
+    if (low < clip->dropoffz)
+        clip->dropoffz = low;
 
     // if contacted a special line, add it to the list
     if (ld->special)
     {
         // 1/11/98 killough: remove limit on lines hit, by array doubling
-        if (numspechit >= spechit_max)
+        if (clip->numspechit >= clip->maxspechit)
         {
-            spechit_max = (spechit_max ? spechit_max * 2 : 8);
-            spechit = Z_Realloc(spechit, sizeof(*spechit) * spechit_max);
+            clip->maxspechit = (clip->maxspechit ? clip->maxspechit * 2 : 8);
+            clip->spechit = Z_Realloc(clip->spechit, sizeof(*clip->spechit) * clip->maxspechit);
         }
-        spechit[numspechit++] = ld;
+        clip->spechit[clip->numspechit++] = ld;
     }
 
     return true;
 }
 
+//
+// P_CheckPositionLines
+// Checks if thing can move to (x, y) against the lines around it, starting
+// from the heights already in clip->floorz, clip->ceilingz and
+// clip->dropoffz. Nothing outside of clip is modified, so this can be
+// called for different things from more than one thread at once, as long
+// as each thread passes its own validcounts.
+//
+dboolean P_CheckPositionLines(mobj_t *thing, fixed_t x, fixed_t y, lineclip_t *clip)
+{
+    fixed_t     radius = ((thing->flags & MF_SPECIAL) ? MIN(20 * FRACUNIT, thing->radius) :
+                    thing->radius);
+
+    clip->thing = thing;
+    clip->x = x;
+    clip->y = y;
+    clip->bbox[BOXTOP] = y + radius;
+    clip->bbox[BOXBOTTOM] = y - radius;
+    clip->bbox[BOXRIGHT] = x + radius;
+    clip->bbox[BOXLEFT] = x - radius;
+
+    // Whether object can get out of a sticky situation:
+    clip->unstuck = (thing->player &&           // only players
+                    thing->player->mo == thing);// not voodoo dolls
+
+    clip->ceilingline = NULL;
+    clip->floorline = NULL;
+    clip->blockline = NULL;
+    clip->numspechit = 0;
+
+    return P_BoxLinesIteratorData(clip->bbox, PIT_CheckLine, clip, clip->validcounts, clip->validcount);
+}
+
 //
 // PIT_CheckThing
 //
@@ -696,6 +753,8 @@ dboolean PIT_CheckOnmobjZ(mobj_t * thing)
 //  speciallines[]
 //  numspeciallines
 //
+// Things are checked here, and lines by P_CheckPositionLines().
+//
 dboolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
 {
     int         xl;
@@ -707,6 +766,8 @@ dboolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
     subsector_t *newsubsec;
     fixed_t     radius = ((thing->flags & MF_SPECIAL) ? MIN(20 * FRACUNIT, thing->radius) :
                     thing->radius);
+    lineclip_t  clip;
+    dboolean    result;
 
     tmthing = thing;
 
@@ -754,17 +815,27 @@ dboolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
                 return false;
 
     // check lines
-    xl = (tmbbox[BOXLEFT] - bmaporgx) >> MAPBLOCKSHIFT;
-    xh = (tmbbox[BOXRIGHT] - bmaporgx) >> MAPBLOCKSHIFT;
-    yl = (tmbbox[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT;
-    yh = (tmbbox[BOXTOP] - bmaporgy) >> MAPBLOCKSHIFT;
-
-    for (bx = xl; bx <= xh; ++bx)
-        for (by = yl; by <= yh; ++by)
-            if (!P_BlockLinesIterator(bx, by, PIT_CheckLine))
-                return false;
-
-    return true;
+    clip.floorz = tmfloorz;
+    clip.ceilingz = tmceilingz;
+    clip.dropoffz = tmdropoffz;
+    clip.spechit = spechit;
+    clip.maxspechit = spechit_max;
+    clip.validcounts = NULL;
+    clip.validcount = validcount;
+
+    result = P_CheckPositionLines(thing, x, y, &clip);
+
+    tmfloorz = clip.floorz;
+    tmceilingz = clip.ceilingz;
+    tmdropoffz = clip.dropoffz;
+    ceilingline = clip.ceilingline;
+    floorline = clip.floorline;
+    blockline = clip.blockline;
+    spechit = clip.spechit;
+    spechit_max = clip.maxspechit;
+    numspechit = clip.numspechit;
+
+    return result;
 }
 
 //
@@ -914,8 +985,8 @@ dboolean P_TryMove(mobj_t *thing, fixed_t x, fixed_t y, dboolean dropoff)
                 && tmfloorz - thing->z > 24 * FRACUNIT))
         {
             return (tmunstuck
-                    && !(ceilingline && untouched(ceilingline))
-                    && !(floorline && untouched(floorline)));
+                    && !(ceilingline && untouched(thing, ceilingline))
+                    && !(floorline && untouched(thing, floorline)));
         }
 
         // killough 3/15/98: Allow certain objects to drop off
@@ -1792,6 +1863,14 @@ mobj_t  *bombsource;
 mobj_t  *bombspot;
 int     bombdamage;
 
+// things in range of each explosion, stacked so that an explosion
+//  set off while damaging them keeps its own list
+static mobj_t   **bombthings;
+static int      *bombdists;
+static dboolean *bombvisible;
+static int      numbombthings;
+static int      maxbombthings;
+
 //
 // PIT_RadiusAttack
 // "bombsource" is the creature
@@ -1837,23 +1916,16 @@ dboolean PIT_RadiusAttack(mobj_t *thing)
             return true;
     }
 
-    if (P_CheckSight(thing, bombspot))
+    if (numbombthings == maxbombthings)
     {
-        // must be in direct path
-        P_DamageMobj(thing, bombspot, bombsource, bombdamage - dist);
-
-        // [BH] count number of times player's rockets hit a monster
-        if (bombspot->type == MT_ROCKET && thing->type != MT_BARREL && !(thing->flags & MF_CORPSE))
-        {
-            if (bombspot->nudge == 1)
-            {
-                players[0].shotshit++;
-                stat_shotshit = SafeAdd(stat_shotshit, 1);
-            }
-            bombspot->nudge++;
-        }
+        maxbombthings = (maxbombthings ? maxbombthings * 2 : 64);
+        bombthings = Z_Realloc(bombthings, maxbombthings * sizeof(*bombthings));
+        bombdists = Z_Realloc(bombdists, maxbombthings * sizeof(*bombdists));
+        bombvisible = Z_Realloc(bombvisible, maxbombthings * sizeof(*bombvisible));
     }
 
+    bombthings[numbombthings] = thing;
+    bombdists[numbombthings++] = dist;
     return true;
 }
 
@@ -1870,13 +1942,44 @@ void P_RadiusAttack(mobj_t *spot, mobj_t *source, int damage)
     int         xh = (spot->x + dist - bmaporgx) >> MAPBLOCKSHIFT;
     int         xl = (spot->x - dist - bmaporgx) >> MAPBLOCKSHIFT;
 
+    int         first = numbombthings;
+    int         i;
+
     bombspot = spot;
     bombsource = source;
     bombdamage = damage;
 
+    // gather everything in range first, then check sight from the
+    //  explosion to all of them at once before damaging any of them
     for (y = yl; y <= yh; ++y)
         for (x = xl; x <= xh; ++x)
             P_BlockThingsIterator(x, y, PIT_RadiusAttack);
+
+    P_CheckSightBatch(bombthings + first, numbombthings - first, spot, bombvisible + first);
+
+    for (i = first; i < numbombthings; ++i)
+    {
+        mobj_t  *thing = bombthings[i];
+
+        // must be in direct path
+        if (!bombvisible[i])
+            continue;
+
+        P_DamageMobj(thing, bombspot, bombsource, bombdamage - bombdists[i]);
+
+        // [BH] count number of times player's rockets hit a monster
+        if (bombspot->type == MT_ROCKET && thing->type != MT_BARREL && !(thing->flags & MF_CORPSE))
+        {
+            if (bombspot->nudge == 1)
+            {
+                players[0].shotshit++;
+                stat_shotshit = SafeAdd(stat_shotshit, 1);
+            }
+            bombspot->nudge++;
+        }
+    }
+
+    numbombthings = first;
 }
 
 //
@@ -1896,6 +1999,10 @@ static dboolean crushchange;
 static dboolean nofit;
 static dboolean isliquidsector;
 
+// incremented whenever a node is added to or removed from any
+//  sector's touching_thinglist
+static unsigned int secnodechanges;
+
 void (*P_BloodSplatSpawner)(fixed_t, fixed_t, int, int, mobj_t *);
 
 //
@@ -1986,62 +2093,79 @@ void PIT_ChangeSector(mobj_t *thing)
 //
 dboolean P_ChangeSector(sector_t *sector, dboolean crunch)
 {
-    msecnode_t  *n;
-    mobj_t      *mobj;
-    mobjtype_t  type;
+    msecnode_t      *n;
+    mobj_t          *mobj;
+    mobjtype_t      type;
+    unsigned int    changes;
 
     nofit = false;
     crushchange = crunch;
     isliquidsector = isliquid[sector->floorpic];
 
+    ++sectorchanges;
+
     // Mark all things invalid
     for (n = sector->touching_thinglist; n; n = n->m_snext)
         n->visited = false;
 
+    // rather than always starting over from the head of the list after
+    //  processing a thing, only do so if the list has changed since
     if (isliquidsector)
     {
-        do
-            for (n = sector->touching_thinglist; n; n = n->m_snext)     // go through list
-                if (!n->visited)                                        // unprocessed thing found
+        n = sector->touching_thinglist;
+
+        while (n)                                                       // go through list
+        {
+            if (n->visited)
+            {
+                n = n->m_snext;
+                continue;
+            }
+
+            n->visited = true;                                          // mark thing as processed
+            changes = secnodechanges;
+            mobj = n->m_thing;
+            if (mobj)
+            {
+                type = mobj->type;
+                if (type == MT_BLOODSPLAT)
                 {
-                    n->visited = true;                                  // mark thing as processed
-                    mobj = n->m_thing;
-                    if (mobj)
-                    {
-                        type = mobj->type;
-                        if (type == MT_BLOODSPLAT)
-                        {
-                            P_UnsetThingPosition(mobj);
-                            --r_bloodsplats_total;
-                        }
-                        else if (type != MT_SHADOW && !(mobj->flags & MF_NOBLOCKMAP))
-                            PIT_ChangeSector(mobj);                     // process it
-                    }
-                    break;                                              // exit and start over
+                    P_UnsetThingPosition(mobj);
+                    --r_bloodsplats_total;
                 }
-        while (n);      // repeat from scratch until all things left are marked valid
+                else if (type != MT_SHADOW && !(mobj->flags & MF_NOBLOCKMAP))
+                    PIT_ChangeSector(mobj);                             // process it
+            }
+            n = (secnodechanges == changes ? n->m_snext : sector->touching_thinglist);
+        }
     }
     else
     {
         sector->floor_xoffs = 0;
         sector->floor_yoffs = 0;
 
-        do
-            for (n = sector->touching_thinglist; n; n = n->m_snext)     // go through list
-                if (!n->visited)                                        // unprocessed thing found
-                {
-                    n->visited = true;                                  // mark thing as processed
-                    mobj = n->m_thing;
-                    if (mobj)
-                    {
-                        type = mobj->type;
-                        if (type != MT_BLOODSPLAT && type != MT_SHADOW
-                            && !(mobj->flags & MF_NOBLOCKMAP))
-                            PIT_ChangeSector(mobj);                     // process it
-                    }
-                    break;                                              // exit and start over
-                }
-        while (n);      // repeat from scratch until all things left are marked valid
+        n = sector->touching_thinglist;
+
+        while (n)                                                       // go through list
+        {
+            if (n->visited)
+            {
+                n = n->m_snext;
+                continue;
+            }
+
+            n->visited = true;                                          // mark thing as processed
+            changes = secnodechanges;
+            mobj = n->m_thing;
+            if (mobj)
+            {
+                type = mobj->type;
+                if (type != MT_BLOODSPLAT && type != MT_SHADOW
+                    && !(mobj->flags & MF_NOBLOCKMAP))
+                    PIT_ChangeSector(mobj);                             // process it
+            }
+            n = (secnodechanges == changes ? n->m_snext : sector->touching_thinglist);
+        }
     }
 
     return nofit;
@@ -2052,6 +2176,12 @@ dboolean P_ChangeSector(sector_t *sector, dboolean crunch)
 // Maintain a freelist of msecnode_t's to reduce memory allocs and frees.
 msecnode_t      *headsecnode = NULL;
 
+#define SECNODECHUNK    256
+
+// how far the edges of tmthing's bbox can move without it touching any
+//  more lines than it does now
+static fixed_t  tmsecnodebox[4];
+
 void P_FreeSecNodeList(void)
 {
     headsecnode = NULL; // this is all that's needed to fix the bug
@@ -2061,12 +2191,27 @@ void P_FreeSecNodeList(void)
 // should make sure it sets all fields properly.
 //
 // killough 11/98: reformatted
+//
+// nodes are allocated SECNODECHUNK at a time rather than individually
 static msecnode_t *P_GetSecnode(void)
 {
     msecnode_t  *node;
 
-    return (headsecnode ? node = headsecnode, headsecnode = node->m_snext, node :
-        Z_Malloc(sizeof(*node), PU_LEVEL, NULL));
+    if (!headsecnode)
+    {
+        int i;
+
+        headsecnode = Z_Malloc(SECNODECHUNK * sizeof(*headsecnode), PU_LEVEL, NULL);
+
+        for (i = 0; i < SECNODECHUNK - 1; ++i)
+            headsecnode[i].m_snext = &headsecnode[i + 1];
+
+        headsecnode[SECNODECHUNK - 1].m_snext = NULL;
+    }
+
+    node = headsecnode;
+    headsecnode = node->m_snext;
+    return node;
 }
 
 // P_PutSecnode() returns a node to the freelist.
@@ -2116,6 +2261,7 @@ static msecnode_t *P_AddSecnode(sector_t *s, mobj_t *thing, msecnode_t *nextnode
     if (s->touching_thinglist)
         node->m_snext->m_sprev = node;
     s->touching_thinglist = node;
+    ++secnodechanges;
     return node;
 }
 
@@ -2156,6 +2302,7 @@ static msecnode_t *P_DelSecnode(msecnode_t *node)
 
         // Return this node to the freelist
         P_PutSecnode(node);
+        ++secnodechanges;
         return tn;
     }
     return NULL;
@@ -2181,7 +2328,31 @@ static dboolean PIT_GetSectors(line_t *ld)
         || tmbbox[BOXLEFT] >= ld->bbox[BOXRIGHT]
         || tmbbox[BOXTOP] <= ld->bbox[BOXBOTTOM]
         || tmbbox[BOXBOTTOM] >= ld->bbox[BOXTOP])
+    {
+        // keep the bbox on the side of the line's bbox it is furthest from
+        fixed_t gapx = MAX(ld->bbox[BOXLEFT] - tmbbox[BOXRIGHT], tmbbox[BOXLEFT] - ld->bbox[BOXRIGHT]);
+        fixed_t gapy = MAX(ld->bbox[BOXBOTTOM] - tmbbox[BOXTOP], tmbbox[BOXBOTTOM] - ld->bbox[BOXTOP]);
+
+        if (gapx >= gapy)
+        {
+            if (tmbbox[BOXRIGHT] <= ld->bbox[BOXLEFT])
+                tmsecnodebox[BOXRIGHT] = MIN(tmsecnodebox[BOXRIGHT], ld->bbox[BOXLEFT]);
+            else
+                tmsecnodebox[BOXLEFT] = MAX(tmsecnodebox[BOXLEFT], ld->bbox[BOXRIGHT]);
+        }
+        else
+        {
+            if (tmbbox[BOXTOP] <= ld->bbox[BOXBOTTOM])
+                tmsecnodebox[BOXTOP] = MIN(tmsecnodebox[BOXTOP], ld->bbox[BOXBOTTOM]);
+            else
+                tmsecnodebox[BOXBOTTOM] = MAX(tmsecnodebox[BOXBOTTOM], ld->bbox[BOXTOP]);
+        }
+
         return true;
+    }
+
+    // the bbox overlaps the line's bbox, so may touch it after any move
+    tmsecnodebox[BOXLEFT] = INT_MAX;
 
     if (P_BoxOnLineSide(tmbbox, ld) != -1)
         return true;
@@ -2227,6 +2398,15 @@ void P_CreateSecNodeList(mobj_t *thing, fixed_t x, fixed_t y)
     fixed_t     saved_tmy = tmy;
     fixed_t     radius = thing->radius;
 
+    // If the only sector the thing touched was the one it's now in, and
+    // its bbox hasn't moved close enough to any line to touch it, reuse its
+    // sector list as is.
+    if (node && !node->m_tnext && node->m_thing == thing
+        && node->m_sector == thing->subsector->sector
+        && x - radius >= thing->secnodebox[BOXLEFT] && x + radius <= thing->secnodebox[BOXRIGHT]
+        && y - radius >= thing->secnodebox[BOXBOTTOM] && y + radius <= thing->secnodebox[BOXTOP])
+        return;
+
     // First, clear out the existing m_thing fields. As each node is
     // added or verified as needed, m_thing will be set properly. When
     // finished, delete all nodes where m_thing is still NULL. These
@@ -2254,10 +2434,18 @@ void P_CreateSecNodeList(mobj_t *thing, fixed_t x, fixed_t y)
     yl = (tmbbox[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT;
     yh = (tmbbox[BOXTOP] - bmaporgy) >> MAPBLOCKSHIFT;
 
+    // the bbox mustn't move into any blocks it isn't in now
+    tmsecnodebox[BOXLEFT] = bmaporgx + (xl << MAPBLOCKSHIFT);
+    tmsecnodebox[BOXRIGHT] = bmaporgx + ((xh + 1) << MAPBLOCKSHIFT) - 1;
+    tmsecnodebox[BOXBOTTOM] = bmaporgy + (yl << MAPBLOCKSHIFT);
+    tmsecnodebox[BOXTOP] = bmaporgy + ((yh + 1) << MAPBLOCKSHIFT) - 1;
+
     for (bx = xl; bx <= xh; ++bx)
         for (by = yl; by <= yh; ++by)
             P_BlockLinesIterator(bx, by, PIT_GetSectors);
 
+    memcpy(thing->secnodebox, tmsecnodebox, sizeof(tmsecnodebox));
+
     // Add the sector of the (x,y) point to sector_list.
     sector_list = P_AddSecnode(thing->subsector->sector, thing, sector_list);
 
@@ -394,6 +394,78 @@ dboolean P_BlockLinesIterator(int x, int y, dboolean func(line_t *))
     }
 }
 
+//
+// P_BoxLinesIteratorData
+// Calls func with data for each line in the blocks touched by bbox, using the
+// finer blockmap if the map has one. If validcounts isn't NULL, lines are
+// marked as checked in it rather than in the lines themselves so it can be
+// called from more than one thread at once.
+//
+dboolean P_BoxLinesIteratorData(const fixed_t *bbox, dboolean func(line_t *, void *), void *data,
+    int *validcounts, int valid)
+{
+    int xl, xh;
+    int yl, yh;
+    int bx, by;
+
+    if (!fineblockshift || !fineblockmap)
+    {
+        xl = MAX(0, (bbox[BOXLEFT] - bmaporgx) >> MAPBLOCKSHIFT);
+        xh = MIN(bmapwidth - 1, (bbox[BOXRIGHT] - bmaporgx) >> MAPBLOCKSHIFT);
+        yl = MAX(0, (bbox[BOXBOTTOM] - bmaporgy) >> MAPBLOCKSHIFT);
+        yh = MIN(bmapheight - 1, (bbox[BOXTOP] - bmaporgy) >> MAPBLOCKSHIFT);
+
+        for (bx = xl; bx <= xh; ++bx)
+            for (by = yl; by <= yh; ++by)
+            {
+                const int   *list;
+
+                for (list = blockmaplump + blockmap[by * bmapwidth + bx] + 1; *list != -1; ++list)
+                {
+                    int     *count = (validcounts ? &validcounts[*list] : &lines[*list].validcount);
+
+                    if (*count == valid)
+                        continue;       // line has already been checked
+
+                    *count = valid;
+
+                    if (!func(&lines[*list], data))
+                        return false;
+                }
+            }
+
+        return true;
+    }
+
+    xl = MAX(0, (bbox[BOXLEFT] - bmaporgx) >> fineblockshift);
+    xh = MIN(fineblockwidth - 1, (bbox[BOXRIGHT] - bmaporgx) >> fineblockshift);
+    yl = MAX(0, (bbox[BOXBOTTOM] - bmaporgy) >> fineblockshift);
+    yh = MIN(fineblockheight - 1, (bbox[BOXTOP] - bmaporgy) >> fineblockshift);
+
+    for (bx = xl; bx <= xh; ++bx)
+        for (by = yl; by <= yh; ++by)
+        {
+            int block = by * fineblockwidth + bx;
+            int i;
+
+            for (i = fineblockoffsets[block]; i < fineblockoffsets[block + 1]; ++i)
+            {
+                int     *count = (validcounts ? &validcounts[fineblocklines[i]] :
+                            &lines[fineblocklines[i]].validcount);
+
+                if (*count == valid)
+                    continue;   // line has already been checked
+
+                *count = valid;
+
+                if (!func(&lines[fineblocklines[i]], data))
+                    return false;
+            }
+        }
+
+    return true;
+}
+
 //
 // P_BlockThingsIterator
 //
@@ -540,6 +612,71 @@ static dboolean PIT_AddThingIntercepts(mobj_t *thing)
     return true;        // keep going
 }
 
+//
+// P_SortIntercepts
+// Sorts the intercepts by frac. The sort is stable, so intercepts at the same
+// frac stay in the order they were added, as they would if each closest one
+// was found in turn.
+//
+static void P_SortIntercepts(intercept_t *first, int count)
+{
+    static intercept_t  *temp;
+    static int          num_temp;
+    int                 width;
+
+    if (count <= 32)
+    {
+        // insertion sort
+        int i;
+
+        for (i = 1; i < count; ++i)
+        {
+            intercept_t in = first[i];
+            int         j = i;
+
+            for (; j > 0 && first[j - 1].frac > in.frac; --j)
+                first[j] = first[j - 1];
+
+            first[j] = in;
+        }
+
+        return;
+    }
+
+    if (count > num_temp)
+    {
+        num_temp = count * 2;
+        temp = Z_Realloc(temp, sizeof(*temp) * num_temp);
+    }
+
+    // bottom-up merge sort
+    for (width = 1; width < count; width *= 2)
+    {
+        int i;
+
+        for (i = 0; i < count; i += width * 2)
+        {
+            int left = i;
+            int mid = MIN(i + width, count);
+            int right = MIN(i + width * 2, count);
+            int j = left;
+            int k = mid;
+            int n = left;
+
+            while (j < mid && k < right)
+                temp[n++] = (first[k].frac < first[j].frac ? first[k++] : first[j++]);
+
+            while (j < mid)
+                temp[n++] = first[j++];
+
+            while (k < right)
+                temp[n++] = first[k++];
+        }
+
+        memcpy(first, temp, sizeof(*first) * count);
+    }
+}
+
 //
 // P_TraverseIntercepts
 // Returns true if the traverser function returns true
@@ -547,28 +684,17 @@ static dboolean PIT_AddThingIntercepts(mobj_t *thing)
 //
 static dboolean P_TraverseIntercepts(traverser_t func, fixed_t maxfrac)
 {
-    int         count = intercept_p - intercepts;
-    intercept_t *in = NULL;
+    intercept_t *in;
 
-    while (count--)
-    {
-        fixed_t         dist = INT_MAX;
-        intercept_t     *scan;
+    P_SortIntercepts(intercepts, intercept_p - intercepts);
 
-        for (scan = intercepts; scan < intercept_p; ++scan)
-            if (scan->frac < dist)
-            {
-                dist = scan->frac;
-                in = scan;
-            }
-
-        if (dist > maxfrac)
+    for (in = intercepts; in < intercept_p; ++in)
+    {
+        if (in->frac > maxfrac)
             return true;        // checked everything in range
 
         if (!func(in))
             return false;       // don't bother going farther
-
-        in->frac = INT_MAX;
     }
 
     return true;                // everything was traversed
@@ -391,6 +391,10 @@ typedef struct mobj_s
     // a linked list of sectors where this object appears
     struct msecnode_s   *touching_sectorlist;   // phares 3/14/98
 
+    // where the edges of its bbox can move without it touching any more
+    //  lines, so touching_sectorlist needn't be rebuilt
+    fixed_t             secnodebox[4];
+
     short               gear;           // killough 11/98: used in torque simulation
 
     int                 bloodsplats;
@@ -412,6 +416,10 @@ typedef struct mobj_s
     fixed_t             nudge;
 
     int                 pitch;
+
+    // index + 1 of the sight check computed for this thing at the start
+    // of the tic by P_PrecomputeSight(), or 0 if none
+    int                 sightcheck;
 } mobj_t;
 
 #endif
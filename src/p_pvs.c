@@ -0,0 +1,630 @@
+/*
+========================================================================
+
+                           D O O M  R e t r o
+         The classic, refined DOOM source port. For Windows PC.
+
+========================================================================
+
+  Copyright  1993-2012 id Software LLC, a ZeniMax Media company.
+  Copyright  2013-2016 Brad Harding.
+
+  DOOM Retro is a fork of Chocolate DOOM.
+  For a list of credits, see the accompanying AUTHORS file.
+
+  This file is part of DOOM Retro.
+
+  DOOM Retro is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation, either version 3 of the License, or (at your
+  option) any later version.
+
+  DOOM Retro is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with DOOM Retro. If not, see <http://www.gnu.org/licenses/>.
+
+  DOOM is a registered trademark of id Software LLC, a ZeniMax Media
+  company, in the US and/or other countries and is used without
+  permission. All other trademarks are the property of their respective
+  holders. DOOM Retro is in no way affiliated with nor endorsed by
+  id Software.
+
+========================================================================
+*/
+
+#include <math.h>
+
+#include "doomstat.h"
+#include "m_misc.h"
+#include "p_local.h"
+#include "p_pvs.h"
+#include "w_wad.h"
+#include "z_zone.h"
+#include "SDL.h"
+
+//
+// Potentially visible set
+//
+// Many PWADs come with an empty REJECT lump, or one too short for their
+// number of sectors, so P_CheckSight() has to trace every line of sight
+// through the BSP. If so, a conservative sector-to-sector visibility matrix
+// is built in the background by flowing through every two-sided line
+// between different sectors, and then combined with REJECT once finished.
+// Sector heights are ignored, since doors and lifts can move, so a sector is
+// only rejected if a line of sight to it would have to pass through a
+// one-sided line. Results are cached on disk, keyed by a hash of the map.
+//
+
+#define PVSVERSION      1
+#define PVSEPSILON      1.0             // map units to err on the side of visible
+#define PVSBUDGET       100000          // portals to flow through from each sector
+
+// a line segment, and the plane (a * x + b * y + c >= 0) on its far side
+typedef struct
+{
+    double      x1, y1;
+    double      x2, y2;
+    double      a, b, c;
+} pvsseg_t;
+
+typedef struct
+{
+    double      x1, y1;
+    double      x2, y2;
+    int         front, back;
+} pvsportal_t;
+
+// a sector being flowed through, and the portals in it still to flow through
+typedef struct
+{
+    int         sector;
+    int         nextportal;             // into sectorportals
+    int         portalnum;              // the portal sector was entered through
+    pvsseg_t    source;
+    pvsseg_t    pass;
+} pvsframe_t;
+
+typedef struct
+{
+    int             numsectors;
+    int             numportals;
+    pvsportal_t     *portals;
+    int             *firstportal;       // into sectorportals, for each sector
+    int             *sectorportals;
+    dboolean        *onpath;
+    byte            *visible;           // numsectors * numsectors bits
+    int             steps;
+    pvsframe_t      *stack;
+    int             maxstack;
+    char            *filename;
+    SDL_atomic_t    cancel;
+    SDL_atomic_t    done;
+} pvs_t;
+
+static pvs_t            *pvs;
+static SDL_Thread       *pvsthread;
+
+static void P_FreePVS(void)
+{
+    free(pvs->portals);
+    free(pvs->firstportal);
+    free(pvs->sectorportals);
+    free(pvs->onpath);
+    free(pvs->visible);
+    free(pvs->stack);
+    free(pvs->filename);
+    free(pvs);
+    pvs = NULL;
+}
+
+static void P_SetVisible(int sector1, int sector2)
+{
+    int pnum = sector1 * pvs->numsectors + sector2;
+
+    pvs->visible[pnum >> 3] |= 1 << (pnum & 7);
+}
+
+static dboolean P_IsVisible(int sector1, int sector2)
+{
+    int pnum = sector1 * pvs->numsectors + sector2;
+
+    return !!(pvs->visible[pnum >> 3] & (1 << (pnum & 7)));
+}
+
+//
+// P_MakePVSSeg
+// Returns the segment of a portal, with its plane facing into sector.
+//
+static pvsseg_t P_MakePVSSeg(const pvsportal_t *portal, int sector)
+{
+    pvsseg_t    seg;
+    double      dx = portal->x2 - portal->x1;
+    double      dy = portal->y2 - portal->y1;
+    double      length = sqrt(dx * dx + dy * dy);
+
+    seg.x1 = portal->x1;
+    seg.y1 = portal->y1;
+    seg.x2 = portal->x2;
+    seg.y2 = portal->y2;
+
+    // the back of a line is on its left
+    seg.a = -dy / length;
+    seg.b = dx / length;
+    seg.c = -(seg.a * seg.x1 + seg.b * seg.y1);
+
+    if (sector == portal->front)
+    {
+        seg.a = -seg.a;
+        seg.b = -seg.b;
+        seg.c = -seg.c;
+    }
+
+    return seg;
+}
+
+//
+// P_ClipPVSSeg
+// Clips a segment to the side of a plane given. Returns false if nothing is
+// left of it.
+//
+static dboolean P_ClipPVSSeg(pvsseg_t *seg, double a, double b, double c)
+{
+    double  d1 = a * seg->x1 + b * seg->y1 + c + PVSEPSILON;
+    double  d2 = a * seg->x2 + b * seg->y2 + c + PVSEPSILON;
+    double  frac;
+
+    if (d1 >= 0.0 && d2 >= 0.0)
+        return true;
+
+    if (d1 < 0.0 && d2 < 0.0)
+        return false;
+
+    frac = d1 / (d1 - d2);
+
+    if (d1 < 0.0)
+    {
+        seg->x1 += (seg->x2 - seg->x1) * frac;
+        seg->y1 += (seg->y2 - seg->y1) * frac;
+    }
+    else
+    {
+        seg->x2 = seg->x1 + (seg->x2 - seg->x1) * frac;
+        seg->y2 = seg->y1 + (seg->y2 - seg->y1) * frac;
+    }
+
+    return true;
+}
+
+//
+// P_ClipToAntiPenumbra
+// Clips a segment beyond pass to the region that can be seen from anywhere
+// on source through pass. This is bounded by the lines through an end of
+// source and the opposite end of pass, that separate the two.
+//
+static dboolean P_ClipToAntiPenumbra(pvsseg_t *seg, const pvsseg_t *source, const pvsseg_t *pass)
+{
+    const double    sx[2] = { source->x1, source->x2 };
+    const double    sy[2] = { source->y1, source->y2 };
+    const double    px[2] = { pass->x1, pass->x2 };
+    const double    py[2] = { pass->y1, pass->y2 };
+    int             i, j;
+
+    for (i = 0; i < 2; ++i)
+        for (j = 0; j < 2; ++j)
+        {
+            double  dx = px[j] - sx[i];
+            double  dy = py[j] - sy[i];
+            double  length = sqrt(dx * dx + dy * dy);
+            double  a, b, c;
+            double  ds, dp;
+
+            if (length < PVSEPSILON)
+                continue;
+
+            a = -dy / length;
+            b = dx / length;
+            c = -(a * sx[i] + b * sy[i]);
+            ds = a * sx[!i] + b * sy[!i] + c;
+            dp = a * px[!j] + b * py[!j] + c;
+
+            // not a separating line?
+            if (fabs(ds) < PVSEPSILON || fabs(dp) < PVSEPSILON || (ds < 0.0) == (dp < 0.0))
+                continue;
+
+            if (dp < 0.0 ? !P_ClipPVSSeg(seg, -a, -b, -c) : !P_ClipPVSSeg(seg, a, b, c))
+                return false;
+        }
+
+    return true;
+}
+
+//
+// P_FlowThroughSector
+// Having entered sector through portalnum, the first portal from
+// sourcesector, marks every sector that can be seen through its other
+// portals, and the portals beyond those. At each step, source is the part of
+// the first portal that a line of sight through every portal so far can come
+// from, and pass the part of the last portal it can go through. The portals
+// on the path are kept on a stack rather than recursing, since the path can
+// be far longer than a thread's stack has room for. Returns false if too
+// many portals have been flowed through from this sector.
+//
+static dboolean P_FlowThroughSector(int sourcesector, const pvsseg_t *first, int portalnum,
+    int sector)
+{
+    int depth = 1;
+
+    if (!pvs->maxstack)
+    {
+        if (!(pvs->stack = malloc(64 * sizeof(*pvs->stack))))
+            return false;
+
+        pvs->maxstack = 64;
+    }
+
+    pvs->stack[0].sector = sector;
+    pvs->stack[0].nextportal = pvs->firstportal[sector];
+    pvs->stack[0].portalnum = portalnum;
+    pvs->stack[0].source = *first;
+    pvs->stack[0].pass = *first;
+
+    while (depth)
+    {
+        pvsframe_t          *frame = &pvs->stack[depth - 1];
+        const pvsportal_t   *portal;
+        int                 next;
+        pvsseg_t            seg;
+        pvsseg_t            newsource;
+
+        if (frame->nextportal == pvs->firstportal[frame->sector + 1])
+        {
+            // every portal out of this sector has been flowed through
+            if (--depth)
+                pvs->onpath[frame->portalnum] = false;
+
+            continue;
+        }
+
+        portalnum = pvs->sectorportals[frame->nextportal++];
+        portal = &pvs->portals[portalnum];
+        next = (portal->front == frame->sector ? portal->back : portal->front);
+
+        // a line of sight can't cross the same line twice
+        if (pvs->onpath[portalnum])
+            continue;
+
+        if (++pvs->steps > PVSBUDGET)
+            break;
+
+        seg = P_MakePVSSeg(portal, next);
+
+        if (!P_ClipPVSSeg(&seg, frame->pass.a, frame->pass.b, frame->pass.c)
+            || !P_ClipPVSSeg(&seg, frame->source.a, frame->source.b, frame->source.c)
+            || (depth > 1 && !P_ClipToAntiPenumbra(&seg, &frame->source, &frame->pass)))
+            continue;
+
+        P_SetVisible(sourcesector, next);
+
+        // only the part of source in front of this portal can see through it
+        newsource = frame->source;
+
+        if (!P_ClipPVSSeg(&newsource, -seg.a, -seg.b, -seg.c))
+            continue;
+
+        if (depth == pvs->maxstack)
+        {
+            pvsframe_t  *stack = realloc(pvs->stack, pvs->maxstack * 2 * sizeof(*stack));
+
+            if (!stack)
+                break;
+
+            pvs->stack = stack;
+            pvs->maxstack *= 2;
+        }
+
+        frame = &pvs->stack[depth++];
+        frame->sector = next;
+        frame->nextportal = pvs->firstportal[next];
+        frame->portalnum = portalnum;
+        frame->source = newsource;
+        frame->pass = seg;
+        pvs->onpath[portalnum] = true;
+    }
+
+    if (!depth)
+        return true;
+
+    // gave up, so take every portal but the first off the path
+    while (--depth)
+        pvs->onpath[pvs->stack[depth].portalnum] = false;
+
+    return false;
+}
+
+//
+// P_BuildPVSForSector
+//
+static void P_BuildPVSForSector(int sector)
+{
+    int i;
+
+    P_SetVisible(sector, sector);
+    pvs->steps = 0;
+
+    for (i = pvs->firstportal[sector]; i < pvs->firstportal[sector + 1]; ++i)
+    {
+        int                 portalnum = pvs->sectorportals[i];
+        const pvsportal_t   *portal = &pvs->portals[portalnum];
+        int                 next = (portal->front == sector ? portal->back : portal->front);
+        pvsseg_t            seg = P_MakePVSSeg(portal, next);
+        dboolean            result;
+
+        P_SetVisible(sector, next);
+
+        pvs->onpath[portalnum] = true;
+        result = P_FlowThroughSector(sector, &seg, portalnum, next);
+        pvs->onpath[portalnum] = false;
+
+        if (!result)
+        {
+            // too complex, so assume everything can be seen from this sector
+            int j;
+
+            for (j = 0; j < pvs->numsectors; ++j)
+                P_SetVisible(sector, j);
+
+            break;
+        }
+    }
+}
+
+static int P_PVSThread(void *data)
+{
+    int     numsectors = pvs->numsectors;
+    int     i, j;
+    FILE    *file;
+
+    for (i = 0; i < numsectors; ++i)
+    {
+        if (SDL_AtomicGet(&pvs->cancel))
+            return 0;
+
+        P_BuildPVSForSector(i);
+    }
+
+    // if either sector can see the other, then both can
+    for (i = 0; i < numsectors; ++i)
+        for (j = i + 1; j < numsectors; ++j)
+            if (P_IsVisible(i, j) || P_IsVisible(j, i))
+            {
+                P_SetVisible(i, j);
+                P_SetVisible(j, i);
+            }
+
+    if ((file = fopen(pvs->filename, "wb")))
+    {
+        fwrite(pvs->visible, 1, (numsectors * numsectors + 7) / 8, file);
+        fclose(file);
+    }
+
+    SDL_AtomicSet(&pvs->done, 1);
+    return 0;
+}
+
+//
+// P_ApplyPVS
+// Rejects every pair of sectors that can't see each other.
+//
+static void P_ApplyPVS(void)
+{
+    int     required = (numsectors * numsectors + 7) / 8;
+    byte    *reject = Z_Malloc(required, PU_LEVEL, NULL);
+    int     i;
+
+    for (i = 0; i < required; ++i)
+        reject[i] = (rejectmatrix[i] | ~pvs->visible[i]);
+
+    rejectmatrix = reject;
+
+    // any sight checks already made may now be rejected
+    ++sectorchanges;
+}
+
+//
+// P_SectorsAreClosed
+// Checks that each sector is enclosed by its lines, by making sure every
+// vertex is shared by an even number of them.
+//
+static int P_CompareSectorVertex(const void *a, const void *b)
+{
+    uint64_t    key1 = *(const uint64_t *)a;
+    uint64_t    key2 = *(const uint64_t *)b;
+
+    return (key1 < key2 ? -1 : key1 > key2);
+}
+
+static dboolean P_SectorsAreClosed(void)
+{
+    uint64_t    *keys = malloc(numlines * 4 * sizeof(*keys));
+    int         numkeys = 0;
+    int         i, j;
+    dboolean    result = true;
+
+    for (i = 0; i < numlines; ++i)
+    {
+        line_t  *line = &lines[i];
+
+        if (line->frontsector == line->backsector)
+            continue;
+
+        if (line->frontsector)
+        {
+            keys[numkeys++] = ((uint64_t)(line->frontsector - sectors) << 32) | (line->v1 - vertexes);
+            keys[numkeys++] = ((uint64_t)(line->frontsector - sectors) << 32) | (line->v2 - vertexes);
+        }
+
+        if (line->backsector)
+        {
+            keys[numkeys++] = ((uint64_t)(line->backsector - sectors) << 32) | (line->v1 - vertexes);
+            keys[numkeys++] = ((uint64_t)(line->backsector - sectors) << 32) | (line->v2 - vertexes);
+        }
+    }
+
+    qsort(keys, numkeys, sizeof(*keys), P_CompareSectorVertex);
+
+    for (i = 0; i < numkeys && result; i = j)
+    {
+        for (j = i + 1; j < numkeys && keys[j] == keys[i]; ++j);
+
+        if ((j - i) & 1)
+            result = false;
+    }
+
+    free(keys);
+    return result;
+}
+
+//
+// P_InitPVS
+// Called by P_SetupLevel() once REJECT has been loaded, to start building a
+// PVS if it is empty or too short.
+//
+void P_InitPVS(int rejectlumpnum)
+{
+    int         required = (numsectors * numsectors + 7) / 8;
+    int         i;
+    int         numportals = 0;
+    uint64_t    hash = HASHBASIS;
+    int         version = PVSVERSION;
+    char        name[32];
+    char        *folder;
+    FILE        *file;
+
+    if (!numsectors)
+        return;
+
+    if (W_LumpLength(rejectlumpnum) >= (unsigned int)required)
+    {
+        for (i = 0; i < required; ++i)
+            if (rejectmatrix[i])
+                return;
+    }
+
+    if (!P_SectorsAreClosed())
+        return;
+
+    pvs = calloc(1, sizeof(*pvs));
+    pvs->numsectors = numsectors;
+    pvs->portals = malloc(numlines * sizeof(*pvs->portals));
+    pvs->firstportal = calloc(numsectors + 1, sizeof(*pvs->firstportal));
+
+    for (i = 0; i < numlines; ++i)
+    {
+        line_t  *line = &lines[i];
+
+        if ((line->flags & ML_TWOSIDED) && line->frontsector && line->backsector
+            && line->frontsector != line->backsector)
+        {
+            pvsportal_t *portal = &pvs->portals[numportals++];
+
+            portal->x1 = (double)line->v1->x / FRACUNIT;
+            portal->y1 = (double)line->v1->y / FRACUNIT;
+            portal->x2 = (double)line->v2->x / FRACUNIT;
+            portal->y2 = (double)line->v2->y / FRACUNIT;
+            portal->front = line->frontsector - sectors;
+            portal->back = line->backsector - sectors;
+            pvs->firstportal[portal->front + 1]++;
+            pvs->firstportal[portal->back + 1]++;
+        }
+    }
+
+    pvs->numportals = numportals;
+    pvs->sectorportals = malloc(MAX(1, numportals * 2) * sizeof(*pvs->sectorportals));
+    pvs->onpath = calloc(MAX(1, numportals), sizeof(*pvs->onpath));
+    pvs->visible = calloc(required, 1);
+
+    for (i = 0; i < numsectors; ++i)
+        pvs->firstportal[i + 1] += pvs->firstportal[i];
+
+    {
+        int *count = calloc(numsectors, sizeof(*count));
+
+        for (i = 0; i < numportals; ++i)
+        {
+            pvsportal_t *portal = &pvs->portals[i];
+
+            pvs->sectorportals[pvs->firstportal[portal->front] + count[portal->front]++] = i;
+            pvs->sectorportals[pvs->firstportal[portal->back] + count[portal->back]++] = i;
+        }
+
+        free(count);
+    }
+
+    hash = hashbytes(hash, &version, sizeof(version));
+    hash = hashbytes(hash, &numsectors, sizeof(numsectors));
+    hash = hashbytes(hash, pvs->portals, numportals * sizeof(*pvs->portals));
+
+    folder = M_StringJoin(M_GetAppDataFolder(), DIR_SEPARATOR_S, "pvs", NULL);
+    M_MakeDirectory(folder);
+    M_snprintf(name, sizeof(name), "%016llx.pvs", (unsigned long long)hash);
+    pvs->filename = M_StringJoin(folder, DIR_SEPARATOR_S, name, NULL);
+    free(folder);
+
+    // use the PVS built the last time this map was played if there is one
+    if ((file = fopen(pvs->filename, "rb")))
+    {
+        int length = fread(pvs->visible, 1, required, file);
+
+        fclose(file);
+
+        if (length == required)
+        {
+            P_ApplyPVS();
+            P_FreePVS();
+            return;
+        }
+
+        memset(pvs->visible, 0, required);
+    }
+
+    if (!(pvsthread = SDL_CreateThread(P_PVSThread, "PVS", NULL)))
+        P_FreePVS();
+}
+
+//
+// P_UpdatePVS
+// Called every tic to use the PVS once it has been built.
+//
+void P_UpdatePVS(void)
+{
+    if (pvs && SDL_AtomicGet(&pvs->done))
+    {
+        SDL_WaitThread(pvsthread, NULL);
+        pvsthread = NULL;
+        P_ApplyPVS();
+        P_FreePVS();
+    }
+}
+
+//
+// P_StopPVS
+// Abandons building the PVS before a level is unloaded.
+//
+void P_StopPVS(void)
+{
+    if (pvs)
+    {
+        if (pvsthread)
+        {
+            SDL_AtomicSet(&pvs->cancel, 1);
+            SDL_WaitThread(pvsthread, NULL);
+            pvsthread = NULL;
+        }
+
+        P_FreePVS();
+    }
+}
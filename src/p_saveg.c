@@ -43,17 +43,229 @@
 #include "dstrings.h"
 #include "i_system.h"
 #include "m_misc.h"
+#include "memio.h"
 #include "p_local.h"
 #include "p_saveg.h"
 #include "p_tick.h"
+#include "SDL.h"
 #include "version.h"
 #include "z_zone.h"
 
 #define SAVEGAME_EOF    0x1D
 
-FILE    *save_stream;
-int     savegamelength;
-dboolean savegame_error;
+// The savegame is made up of the header, then a section for each of the
+// P_Archive functions, each starting with a tag and its length.
+#define SAVEGAME_TAG(a, b, c, d)        ((a) | ((b) << 8) | ((c) << 16) | ((d) << 24))
+
+#define SAVEGAME_FORMAT                 SAVEGAME_TAG('D', 'R', 'S', '1')
+
+// After the header of a compressed savegame is the length of the rest of the
+// savegame once decompressed, followed by the compressed data.
+#define SAVEGAME_FORMAT_COMPRESSED      SAVEGAME_TAG('D', 'R', 'Z', '1')
+
+#define SECTION_PLAYERS                 SAVEGAME_TAG('P', 'L', 'Y', 'R')
+#define SECTION_WORLD                   SAVEGAME_TAG('W', 'R', 'L', 'D')
+#define SECTION_THINKERS                SAVEGAME_TAG('T', 'H', 'N', 'K')
+#define SECTION_SPECIALS                SAVEGAME_TAG('S', 'P', 'E', 'C')
+#define SECTION_MAP                     SAVEGAME_TAG('M', 'A', 'P', ' ')
+
+MEMFILE         *save_stream;
+int             savegamelength;
+dboolean        savegame_error;
+
+static byte     *savegamebuffer;
+
+// When writing, the position of the current section's length. When reading,
+// the position the current section should end at.
+static long     savegamesection;
+
+// The savegame being written to disk on a separate thread
+static SDL_Thread       *savegamethread;
+static SDL_atomic_t     savegamewritten;
+static MEMFILE          *savegamewritestream;
+static char             *savegametempfile;
+static char             *savegamefile;
+static int              savegamewriteresult;
+
+// The length of the header, which is never compressed
+static long             savegameheaderlength;
+
+//
+// LZ compression
+// Each sequence is a token, with the number of literals in its high nibble and
+// the length of the match less 4 in its low nibble, followed by any further
+// bytes of the number of literals, the literals themselves, the 16-bit offset
+// of the match and any further bytes of the length of the match. The last
+// sequence only has literals.
+//
+#define LZHASHBITS      14
+#define LZMINMATCH      4
+#define LZMAXOFFSET     65535
+
+#define LZBOUND(length) ((length) + (length) / 255 + 16)
+
+// No byte of compressed data decompresses to more than 255 bytes
+#define LZMAXRATIO      255
+
+static int              lzhashtable[1 << LZHASHBITS];
+
+static unsigned int LZ_Read32(const byte *p)
+{
+    return (p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24));
+}
+
+static byte *LZ_WriteLength(byte *op, int length)
+{
+    while (length >= 255)
+    {
+        *op++ = 255;
+        length -= 255;
+    }
+
+    *op++ = length;
+    return op;
+}
+
+static byte *LZ_WriteSequence(byte *op, const byte *literals, int numliterals, int offset,
+    int matchlength)
+{
+    byte    *token = op++;
+
+    *token = MIN(numliterals, 15) << 4;
+
+    if (numliterals >= 15)
+        op = LZ_WriteLength(op, numliterals - 15);
+
+    memcpy(op, literals, numliterals);
+    op += numliterals;
+
+    if (matchlength)
+    {
+        matchlength -= LZMINMATCH;
+        *token |= MIN(matchlength, 15);
+        *op++ = offset & 0xFF;
+        *op++ = offset >> 8;
+
+        if (matchlength >= 15)
+            op = LZ_WriteLength(op, matchlength - 15);
+    }
+
+    return op;
+}
+
+// Compresses length bytes of src into dest, which must have room for
+// LZBOUND(length) bytes, and returns the length of the result.
+static int LZ_Compress(const byte *src, int length, byte *dest)
+{
+    const byte  *ip = src;
+    const byte  *anchor = src;
+    const byte  *end = src + length;
+    byte        *op = dest;
+    int         i;
+
+    for (i = 0; i < (1 << LZHASHBITS); ++i)
+        lzhashtable[i] = -1;
+
+    while (ip + LZMINMATCH <= end)
+    {
+        unsigned int    sequence = LZ_Read32(ip);
+        unsigned int    hash = (sequence * 2654435761u) >> (32 - LZHASHBITS);
+        int             ref = lzhashtable[hash];
+
+        lzhashtable[hash] = ip - src;
+
+        if (ref >= 0 && ip - src - ref <= LZMAXOFFSET && LZ_Read32(src + ref) == sequence)
+        {
+            const byte  *match = src + ref + LZMINMATCH;
+            const byte  *matchend = ip + LZMINMATCH;
+
+            while (matchend < end && *matchend == *match)
+            {
+                ++matchend;
+                ++match;
+            }
+
+            op = LZ_WriteSequence(op, anchor, ip - anchor, ip - (src + ref), matchend - ip);
+            anchor = ip = matchend;
+        }
+        else
+            ++ip;
+    }
+
+    op = LZ_WriteSequence(op, anchor, end - anchor, 0, 0);
+    return (op - dest);
+}
+
+static dboolean LZ_ReadLength(const byte **ip, const byte *end, int *length)
+{
+    byte    value;
+
+    do
+    {
+        if (*ip >= end)
+            return false;
+
+        value = *(*ip)++;
+        *length += value;
+    } while (value == 255);
+
+    return true;
+}
+
+// Decompresses length bytes of src into dest, which has room for destlength
+// bytes, and returns the length of the result, or -1 if src is corrupt.
+static int LZ_Decompress(const byte *src, int length, byte *dest, int destlength)
+{
+    const byte  *ip = src;
+    const byte  *end = src + length;
+    byte        *op = dest;
+    byte        *destend = dest + destlength;
+
+    while (ip < end)
+    {
+        byte    token = *ip++;
+        int     numliterals = token >> 4;
+        int     matchlength = token & 15;
+        int     offset;
+
+        if (numliterals == 15 && !LZ_ReadLength(&ip, end, &numliterals))
+            return -1;
+
+        if (numliterals > end - ip || numliterals > destend - op)
+            return -1;
+
+        memcpy(op, ip, numliterals);
+        ip += numliterals;
+        op += numliterals;
+
+        // the last sequence has no match
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            return -1;
+
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if (matchlength == 15 && !LZ_ReadLength(&ip, end, &matchlength))
+            return -1;
+
+        matchlength += LZMINMATCH;
+
+        if (!offset || offset > op - dest || matchlength > destend - op)
+            return -1;
+
+        // the match may overlap the bytes it produces
+        while (matchlength--)
+        {
+            *op = *(op - offset);
+            ++op;
+        }
+    }
+
+    return (op - dest);
+}
 
 void P_SpawnShadow(mobj_t *actor);
 
@@ -89,12 +301,189 @@ char *P_SaveGameFile(int slot)
     return filename;
 }
 
+//
+// P_OpenSaveGameForReading
+// Reads the whole of a savegame into memory to be unarchived from there.
+//
+dboolean P_OpenSaveGameForReading(char *filename)
+{
+    FILE        *file = fopen(filename, "rb");
+    long        length;
+
+    if (!file)
+        return false;
+
+    length = M_FileLength(file);
+    savegamebuffer = Z_Malloc(MAX(1, length), PU_STATIC, NULL);
+
+    if ((long)fread(savegamebuffer, 1, length, file) < length)
+    {
+        fclose(file);
+        Z_Free(savegamebuffer);
+        savegamebuffer = NULL;
+        return false;
+    }
+
+    fclose(file);
+
+    save_stream = mem_fopen_read(savegamebuffer, length);
+    savegamesection = -1;
+    savegame_error = false;
+
+    return true;
+}
+
+//
+// P_OpenSaveGameForWriting
+// Archives are built up in memory, and only written out by P_WriteSaveGameFile().
+//
+void P_OpenSaveGameForWriting(void)
+{
+    save_stream = mem_fopen_write();
+    savegamesection = -1;
+    savegame_error = false;
+}
+
+static int SDLCALL P_SaveGameThread(void *data)
+{
+    void        *buffer;
+    size_t      length;
+    byte        *compressed;
+    FILE        *file;
+    int         result = false;
+
+    mem_get_buf(savegamewritestream, &buffer, &length);
+
+    // compress everything after the header, unless it doesn't get any smaller
+    if ((compressed = malloc(savegameheaderlength + 4
+        + LZBOUND(length - savegameheaderlength))))
+    {
+        int     rawlength = length - savegameheaderlength;
+        int     compressedlength = LZ_Compress((byte *)buffer + savegameheaderlength, rawlength,
+                    compressed + savegameheaderlength + 4);
+
+        if (compressedlength + 4 < rawlength)
+        {
+            byte    *p = compressed + savegameheaderlength - 4;
+            int     i;
+
+            memcpy(compressed, buffer, savegameheaderlength - 4);
+
+            for (i = 0; i < 4; ++i)
+                *p++ = (SAVEGAME_FORMAT_COMPRESSED >> (i * 8)) & 0xFF;
+
+            for (i = 0; i < 4; ++i)
+                *p++ = (rawlength >> (i * 8)) & 0xFF;
+
+            buffer = compressed;
+            length = savegameheaderlength + 4 + compressedlength;
+        }
+    }
+
+    if ((file = fopen(savegametempfile, "wb")))
+    {
+        result = (fwrite(buffer, 1, length, file) == length);
+
+        if (fclose(file))
+            result = false;
+    }
+
+    free(compressed);
+
+    // Now rename the temporary savegame file to the actual savegame
+    // file, overwriting the old savegame if there was one there.
+    if (result)
+    {
+        remove(savegamefile);
+        result = !rename(savegametempfile, savegamefile);
+    }
+    else
+        remove(savegametempfile);
+
+    SDL_AtomicSet(&savegamewritten, 1);
+    return result;
+}
+
+//
+// P_WriteSaveGameFile
+// Starts writing the savegame built up in memory to tempfilename in a single
+// call on a separate thread, which then renames it to filename. P_FinishSaveGame()
+// must be called once it's done.
+//
+void P_WriteSaveGameFile(char *tempfilename, char *filename)
+{
+    savegamewritestream = save_stream;
+    save_stream = NULL;
+
+    savegametempfile = strdup(tempfilename);
+    savegamefile = strdup(filename);
+
+    SDL_AtomicSet(&savegamewritten, 0);
+
+    if (!(savegamethread = SDL_CreateThread(P_SaveGameThread, "savegame", NULL)))
+        savegamewriteresult = P_SaveGameThread(NULL);
+}
+
+//
+// P_SaveGameWritten
+// Returns true once the savegame started by P_WriteSaveGameFile() is on disk,
+// or has failed to be.
+//
+dboolean P_SaveGameWritten(void)
+{
+    return (savegamewritestream && SDL_AtomicGet(&savegamewritten));
+}
+
+//
+// P_FinishSaveGame
+// Waits for the savegame started by P_WriteSaveGameFile() to be written, and
+// returns true if it was.
+//
+dboolean P_FinishSaveGame(void)
+{
+    int result = savegamewriteresult;
+
+    if (savegamethread)
+    {
+        SDL_WaitThread(savegamethread, &result);
+        savegamethread = NULL;
+    }
+
+    if (savegamewritestream)
+    {
+        mem_fclose(savegamewritestream);
+        savegamewritestream = NULL;
+    }
+
+    free(savegametempfile);
+    free(savegamefile);
+    savegametempfile = NULL;
+    savegamefile = NULL;
+
+    return result;
+}
+
+void P_CloseSaveGame(void)
+{
+    if (save_stream)
+    {
+        mem_fclose(save_stream);
+        save_stream = NULL;
+    }
+
+    if (savegamebuffer)
+    {
+        Z_Free(savegamebuffer);
+        savegamebuffer = NULL;
+    }
+}
+
 // Endian-safe integer read/write functions
 static byte saveg_read8(void)
 {
-    byte        result;
+    byte        result = 0;
 
-    if (fread(&result, 1, 1, save_stream) < 1)
+    if (mem_fread(&result, 1, 1, save_stream) < 1)
         savegame_error = true;
 
     return result;
@@ -102,50 +491,53 @@ static byte saveg_read8(void)
 
 static void saveg_write8(byte value)
 {
-    if (fwrite(&value, 1, 1, save_stream) < 1)
-        savegame_error = true;
+    mem_fwrite(&value, 1, 1, save_stream);
 }
 
 static short saveg_read16(void)
 {
-    int result;
+    byte        bytes[2] = { 0, 0 };
 
-    result = saveg_read8();
-    result |= saveg_read8() << 8;
+    if (mem_fread(bytes, 1, 2, save_stream) < 2)
+        savegame_error = true;
 
-    return result;
+    return (bytes[0] | (bytes[1] << 8));
 }
 
 static void saveg_write16(short value)
 {
-    saveg_write8(value & 0xFF);
-    saveg_write8((value >> 8) & 0xFF);
+    byte        bytes[2];
+
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
+    mem_fwrite(bytes, 1, 2, save_stream);
 }
 
 static int saveg_read32(void)
 {
-    int result;
+    byte        bytes[4] = { 0, 0, 0, 0 };
 
-    result = saveg_read8();
-    result |= saveg_read8() << 8;
-    result |= saveg_read8() << 16;
-    result |= saveg_read8() << 24;
+    if (mem_fread(bytes, 1, 4, save_stream) < 4)
+        savegame_error = true;
 
-    return result;
+    return (bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24));
 }
 
 static void saveg_write32(int value)
 {
-    saveg_write8(value & 0xFF);
-    saveg_write8((value >> 8) & 0xFF);
-    saveg_write8((value >> 16) & 0xFF);
-    saveg_write8((value >> 24) & 0xFF);
+    byte        bytes[4];
+
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
+    bytes[2] = (value >> 16) & 0xFF;
+    bytes[3] = (value >> 24) & 0xFF;
+    mem_fwrite(bytes, 1, 4, save_stream);
 }
 
 // Pad to 4-byte boundaries
 static void saveg_read_pad(void)
 {
-    unsigned long       pos = ftell(save_stream);
+    unsigned long       pos = mem_ftell(save_stream);
     int                 padding = (4 - (pos & 3)) & 3;
     int                 i;
 
@@ -155,7 +547,7 @@ static void saveg_read_pad(void)
 
 static void saveg_write_pad(void)
 {
-    unsigned long       pos = ftell(save_stream);
+    unsigned long       pos = mem_ftell(save_stream);
     int                 padding = (4 - (pos & 3)) & 3;
     int                 i;
 
@@ -163,6 +555,51 @@ static void saveg_write_pad(void)
         saveg_write8(0);
 }
 
+// Sections
+static void saveg_end_section(void)
+{
+    if (savegamesection >= 0)
+    {
+        long    end = mem_ftell(save_stream);
+
+        mem_fseek(save_stream, savegamesection, MEM_SEEK_SET);
+        saveg_write32(end - savegamesection - 4);
+        mem_fseek(save_stream, end, MEM_SEEK_SET);
+        savegamesection = -1;
+    }
+}
+
+static void saveg_write_section(int tag)
+{
+    saveg_end_section();
+    saveg_write_pad();
+    saveg_write32(tag);
+    savegamesection = mem_ftell(save_stream);
+    saveg_write32(0);
+}
+
+static void saveg_end_read_section(void)
+{
+    if (savegamesection >= 0 && mem_ftell(save_stream) != savegamesection)
+        I_Error("Bad savegame");
+
+    savegamesection = -1;
+}
+
+static void saveg_read_section(int tag)
+{
+    int length;
+
+    saveg_end_read_section();
+    saveg_read_pad();
+
+    if (saveg_read32() != tag)
+        I_Error("Bad savegame");
+
+    length = saveg_read32();
+    savegamesection = mem_ftell(save_stream) + length;
+}
+
 // Pointers
 static void *saveg_readp(void)
 {
@@ -1604,6 +2041,51 @@ void P_WriteSaveGameHeader(char *description)
     saveg_write8((leveltime >> 16) & 0xFF);
     saveg_write8((leveltime >> 8) & 0xFF);
     saveg_write8(leveltime & 0xFF);
+
+    saveg_write_pad();
+    saveg_write32(SAVEGAME_FORMAT);
+
+    savegameheaderlength = mem_ftell(save_stream);
+}
+
+//
+// P_DecompressSaveGame
+// Replaces a compressed savegame being read with the savegame it decompresses
+// to, so the rest of it can be read as normal.
+//
+static dboolean P_DecompressSaveGame(void)
+{
+    long        headerlength = mem_ftell(save_stream);
+    int         rawlength = saveg_read32();
+    void        *buffer;
+    size_t      length;
+    byte        *raw;
+
+    mem_get_buf(save_stream, &buffer, &length);
+
+    // don't trust a length that the compressed data couldn't decompress to
+    if (savegame_error || rawlength < 0
+        || rawlength > (int64_t)(length - headerlength - 4) * LZMAXRATIO)
+        return false;
+
+    raw = Z_Malloc(headerlength + rawlength, PU_STATIC, NULL);
+    memcpy(raw, buffer, headerlength);
+
+    if (LZ_Decompress((byte *)buffer + headerlength + 4, length - headerlength - 4,
+        raw + headerlength, rawlength) != rawlength)
+    {
+        Z_Free(raw);
+        return false;
+    }
+
+    mem_fclose(save_stream);
+    Z_Free(savegamebuffer);
+
+    savegamebuffer = raw;
+    save_stream = mem_fopen_read(savegamebuffer, headerlength + rawlength);
+    mem_fseek(save_stream, headerlength, MEM_SEEK_SET);
+
+    return true;
 }
 
 //
@@ -1615,6 +2097,7 @@ dboolean P_ReadSaveGameHeader(char *description)
     byte        a, b, c;
     char        vcheck[VERSIONSIZE];
     char        read_vcheck[VERSIONSIZE];
+    int         format;
 
     for (i = 0; i < SAVESTRINGSIZE; ++i)
         description[i] = saveg_read8();
@@ -1645,6 +2128,26 @@ dboolean P_ReadSaveGameHeader(char *description)
     c = saveg_read8();
     leveltime = (a << 16) + (b << 8) + c;
 
+    saveg_read_pad();
+    format = saveg_read32();
+
+    if (format == SAVEGAME_FORMAT_COMPRESSED && !P_DecompressSaveGame())
+    {
+        menuactive = false;
+        consoleheight = 1;
+        consoledirection = 1;
+        C_Warning("This savegame is corrupt.");
+        return false;
+    }
+    else if (format != SAVEGAME_FORMAT && format != SAVEGAME_FORMAT_COMPRESSED)
+    {
+        menuactive = false;
+        consoleheight = 1;
+        consoledirection = 1;
+        C_Warning("This savegame is in a format that can't be loaded.");
+        return false;   // bad format
+    }
+
     return true;
 }
 
@@ -1653,6 +2156,8 @@ dboolean P_ReadSaveGameHeader(char *description)
 //
 dboolean P_ReadSaveGameEOF(void)
 {
+    saveg_end_read_section();
+
     return (saveg_read8() == SAVEGAME_EOF);
 }
 
@@ -1661,6 +2166,8 @@ dboolean P_ReadSaveGameEOF(void)
 //
 void P_WriteSaveGameEOF(void)
 {
+    saveg_end_section();
+
     saveg_write8(SAVEGAME_EOF);
 }
 
@@ -1669,6 +2176,8 @@ void P_WriteSaveGameEOF(void)
 //
 void P_ArchivePlayers(void)
 {
+    saveg_write_section(SECTION_PLAYERS);
+
     saveg_write_pad();
 
     saveg_write_player_t(&players[0]);
@@ -1679,6 +2188,8 @@ void P_ArchivePlayers(void)
 //
 void P_UnArchivePlayers(void)
 {
+    saveg_read_section(SECTION_PLAYERS);
+
     saveg_read_pad();
 
     P_InitCards(&players[0]);
@@ -1702,6 +2213,8 @@ void P_ArchiveWorld(void)
     line_t      *li;
     side_t      *si;
 
+    saveg_write_section(SECTION_WORLD);
+
     // do sectors
     for (i = 0, sec = sectors; i < numsectors; i++, sec++)
     {
@@ -1747,6 +2260,8 @@ void P_UnArchiveWorld(void)
     line_t      *li;
     side_t      *si;
 
+    saveg_read_section(SECTION_WORLD);
+
     // do sectors
     for (i = 0, sec = sectors; i < numsectors; i++, sec++)
     {
@@ -1803,6 +2318,8 @@ void P_ArchiveThinkers(void)
     thinker_t   *th;
     int         i;
 
+    saveg_write_section(SECTION_THINKERS);
+
     // save off the current thinkers
     for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj]; th = th->cnext)
     {
@@ -1854,6 +2371,8 @@ void P_UnArchiveThinkers(void)
     thinker_t   *next;
     int i;
 
+    saveg_read_section(SECTION_THINKERS);
+
     // remove all the current thinkers
     while (currentthinker != &thinkercap)
     {
@@ -2020,6 +2539,8 @@ void P_ArchiveSpecials(void)
     int         i;
     button_t    *button_ptr;
 
+    saveg_write_section(SECTION_SPECIALS);
+
     // save off the current thinkers
     for (th = thinkerclasscap[th_misc].cnext; th != &thinkerclasscap[th_misc]; th = th->cnext)
     {
@@ -2181,6 +2702,8 @@ void P_UnArchiveSpecials(void)
     pusher_t            *pusher;
     button_t            *button;
 
+    saveg_read_section(SECTION_SPECIALS);
+
     // read in saved thinkers
     while (1)
     {
@@ -2304,6 +2827,8 @@ void P_UnArchiveSpecials(void)
 //
 void P_ArchiveMap(void)
 {
+    saveg_write_section(SECTION_MAP);
+
     saveg_write32(automapactive);
     saveg_write32(markpointnum);
 
@@ -2324,6 +2849,8 @@ void P_ArchiveMap(void)
 //
 void P_UnArchiveMap(void)
 {
+    saveg_read_section(SECTION_MAP);
+
     automapactive = saveg_read32();
     markpointnum = saveg_read32();
 
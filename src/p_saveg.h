@@ -39,7 +39,7 @@
 #if !defined(__P_SAVEG__)
 #define __P_SAVEG__
 
-#include <stdio.h>
+#include "memio.h"
 
 // maximum size of a savegame description
 #define SAVESTRINGSIZE          256
@@ -52,6 +52,14 @@ char *P_TempSaveGameFile(void);
 // filename to use for a savegame slot
 char *P_SaveGameFile(int slot);
 
+// Savegames are read and written in memory
+dboolean P_OpenSaveGameForReading(char *filename);
+void P_OpenSaveGameForWriting(void);
+void P_WriteSaveGameFile(char *tempfilename, char *filename);
+dboolean P_SaveGameWritten(void);
+dboolean P_FinishSaveGame(void);
+void P_CloseSaveGame(void);
+
 // Savegame file header read/write functions
 dboolean P_ReadSaveGameHeader(char *description);
 void P_WriteSaveGameHeader(char *description);
@@ -77,7 +85,7 @@ uint32_t P_ThinkerToIndex(thinker_t *thinker);
 thinker_t *P_IndexToThinker(uint32_t index);
 void P_RestoreTargets(void);
 
-extern FILE *save_stream;
+extern MEMFILE *save_stream;
 extern dboolean savegame_error;
 
 #endif
@@ -44,18 +44,21 @@
 #include "g_game.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_thread.h"
 #include "m_argv.h"
 #include "m_bbox.h"
 #include "m_misc.h"
 #include "m_random.h"
 #include "p_fix.h"
 #include "p_local.h"
+#include "p_pvs.h"
 #include "p_setup.h"
 #include "p_tick.h"
 #include "s_sound.h"
 #include "sc_man.h"
 #include "w_wad.h"
 #include "z_zone.h"
+#include "SDL.h"
 
 #define MAPINFO_SCRIPT_NAME     "MAPINFO"
 
@@ -151,6 +154,16 @@ fixed_t         bmaporgy;
 // for thing chains
 mobj_t          **blocklinks;
 
+// finer blockmap of lines only, for maps with many lines in each block
+int             fineblockshift;                 // 0 if there isn't one
+int             fineblockwidth;
+int             fineblockheight;
+int             *fineblockoffsets;              // into fineblocklines, for each block
+int             *fineblocklines;
+static dboolean fineblockmapcreated;
+
+dboolean        fineblockmap = fineblockmap_default;
+
 // REJECT
 // For fast sight rejection.
 // Speeds up enemy AI by skipping detailed
@@ -200,11 +213,50 @@ static int      current_episode = -1;
 static int      current_map = -1;
 static int      samelevel;
 
+// time taken by each stage of P_SetupLevel() for the current map
+loadstat_t      loadstats[] =
+{
+    { "Vertices",        0 },
+    { "Sectors",         0 },
+    { "Sides",           0 },
+    { "Lines",           0 },
+    { "Blockmap",        0 },
+    { "Nodes",           0 },
+    { "Grouping lines",  0 },
+    { "Sight and sound", 0 },
+    { "Slime trails",    0 },
+    { "Segment lengths", 0 },
+    { "Things",          0 },
+    { "Specials",        0 },
+    { "Precaching",      0 },
+    { "Total",           0 },
+    { "",                0 }
+};
+
+static uint64_t P_LoadStat(int stat, uint64_t start)
+{
+    uint64_t    now = SDL_GetPerformanceCounter();
+
+    loadstats[stat].time = now - start;
+    return now;
+}
+
 mapformat_t     mapformat;
 
 dboolean        boomlinespecials;
 dboolean        blockmaprecreated;
 
+// blockmap created by P_CreateBlockMap(), for P_FinishBlockMap() to take
+static struct
+{
+    int         numvertexes;            // vertices in the map before the nodes add any
+    fixed_t     orgx;
+    fixed_t     orgy;
+    int         width;
+    int         height;
+    int         *lump;
+} newblockmap;
+
 extern fixed_t  animatedliquiddiff;
 extern fixed_t  animatedliquidxdir;
 extern fixed_t  animatedliquidydir;
@@ -1316,6 +1368,10 @@ static void P_LoadSideDefs2(int lump)
 // Please note: This section of code is not interchangeable with TeamTNT's
 // code which attempts to fix the same problem.
 //
+// It is run as a task by P_RunGroupTasks(), so it only allocates with malloc()
+// and leaves the blockmap in newblockmap for the main thread to take. The
+// lump is left NULL if it can't be created.
+//
 static void P_CreateBlockMap(void)
 {
     int         i;
@@ -1324,10 +1380,13 @@ static void P_CreateBlockMap(void)
     fixed_t     maxx = INT_MIN;
     fixed_t     maxy = INT_MIN;
     vertex_t    *vertex;
+    int         bmapwidth;
+    int         bmapheight;
+    int         *blockmaplump;
 
     // First find limits of map
     vertex = vertexes;
-    i = numvertexes;
+    i = newblockmap.numvertexes;
     do
     {
         fixed_t j = vertex->x >> FRACBITS;
@@ -1345,10 +1404,11 @@ static void P_CreateBlockMap(void)
     } while (--i);
 
     // Save blockmap parameters
-    bmaporgx = minx << FRACBITS;
-    bmaporgy = miny << FRACBITS;
-    bmapwidth = ((maxx - minx) >> MAPBTOFRAC) + 1;
-    bmapheight = ((maxy - miny) >> MAPBTOFRAC) + 1;
+    newblockmap.orgx = minx << FRACBITS;
+    newblockmap.orgy = miny << FRACBITS;
+    newblockmap.width = bmapwidth = ((maxx - minx) >> MAPBTOFRAC) + 1;
+    newblockmap.height = bmapheight = ((maxy - miny) >> MAPBTOFRAC) + 1;
+    newblockmap.lump = NULL;
 
     // Compute blockmap, which is stored as a 2d array of variable-sized lists.
     //
@@ -1377,7 +1437,7 @@ static void P_CreateBlockMap(void)
         bmap_t          *bmap = calloc(sizeof(*bmap), tot);     // array of blocklists
 
         if (!bmap)
-            I_Error("Unable to create blockmap.");
+            return;
 
         for (i = 0; i < numlines; i++)
         {
@@ -1418,9 +1478,22 @@ static void P_CreateBlockMap(void)
                 bmap_t  *bp = &bmap[b];
 
                 // Increase size of allocated list if necessary
-                if (bp->n >= bp->nalloc && !(bp->list = Z_Realloc(bp->list,
-                    (bp->nalloc = bp->nalloc ? bp->nalloc * 2 : 8) * sizeof(*bp->list))))
-                    I_Error("Unable to create blockmap.");
+                if (bp->n >= bp->nalloc)
+                {
+                    int *list = Z_Realloc(bp->list,
+                            (bp->nalloc = bp->nalloc ? bp->nalloc * 2 : 8) * sizeof(*bp->list));
+
+                    if (!list)
+                    {
+                        for (b = 0; (unsigned int)b < tot; b++)
+                            free(bmap[b].list);
+
+                        free(bmap);
+                        return;
+                    }
+
+                    bp->list = list;
+                }
 
                 // Add linedef to end of list
                 bp->list[bp->n++] = i;
@@ -1457,7 +1530,14 @@ static void P_CreateBlockMap(void)
                     count += bmap[i].n + 2;     // 1 header word + 1 trailer word + blocklist
 
             // Allocate blockmap lump with computed count
-            blockmaplump = malloc_IfSameLevel(blockmaplump, sizeof(*blockmaplump) * count);
+            if (!(blockmaplump = malloc(sizeof(*blockmaplump) * count)))
+            {
+                for (i = 0; (unsigned int)i < tot; i++)
+                    free(bmap[i].list);
+
+                free(bmap);
+                return;
+            }
         }
 
         // Now compress the blockmap.
@@ -1484,6 +1564,8 @@ static void P_CreateBlockMap(void)
 
             free(bmap);                 // Free uncompressed blockmap
         }
+
+        newblockmap.lump = blockmaplump;
     }
 }
 
@@ -1504,7 +1586,8 @@ void P_LoadBlockMap(int lump)
     blockmaprecreated = false;
     if (lump >= numlumps || (lumplen = W_LumpLength(lump)) < 8 || (count = lumplen / 2) >= 0x10000)
     {
-        P_CreateBlockMap();
+        // created by P_RunGroupTasks() once the nodes are loaded
+        newblockmap.numvertexes = numvertexes;
         blockmaprecreated = true;
     }
     else
@@ -1539,12 +1622,177 @@ void P_LoadBlockMap(int lump)
         bmapwidth = blockmaplump[2];
         bmapheight = blockmaplump[3];
     }
+}
+
+//
+// P_FinishBlockMap
+// Takes the blockmap created by P_CreateBlockMap(), if there is one, and
+// clears out the mobj chains.
+//
+static void P_FinishBlockMap(void)
+{
+    if (blockmaprecreated)
+    {
+        if (!newblockmap.lump)
+            I_Error("Unable to create blockmap.");
+
+        bmaporgx = newblockmap.orgx;
+        bmaporgy = newblockmap.orgy;
+        bmapwidth = newblockmap.width;
+        bmapheight = newblockmap.height;
+        blockmaplump = newblockmap.lump;
+        newblockmap.lump = NULL;
+    }
 
     // Clear out mobj chains
     blocklinks = calloc_IfSameLevel(blocklinks, bmapwidth * bmapheight, sizeof(*blocklinks));
     blockmap = blockmaplump + 4;
 }
 
+//
+// P_RasterizeFineBlockLine
+// Finds every block of the finer blockmap that a line passes through, and
+// either counts the line in them or adds it to their lists. Blocks within a
+// map unit of the line are included, so that no block that a thing touching
+// the line could be in is missed.
+//
+static void P_RasterizeFineBlockLine(int i, int *counts, int *positions)
+{
+    line_t      *line = &lines[i];
+    int64_t     x1 = (int64_t)line->v1->x - bmaporgx;
+    int64_t     y1 = (int64_t)line->v1->y - bmaporgy;
+    int64_t     x2 = (int64_t)line->v2->x - bmaporgx;
+    int64_t     y2 = (int64_t)line->v2->y - bmaporgy;
+    int64_t     ylo = (y1 < y2 ? y1 : y2);
+    int64_t     yhi = (y1 < y2 ? y2 : y1);
+    int64_t     size = (int64_t)1 << fineblockshift;
+    int         row = (ylo - FRACUNIT < 0 ? 0 : (int)((ylo - FRACUNIT) / size));
+    int         lastrow = (int)((yhi + FRACUNIT) / size);
+
+    if (lastrow >= fineblockheight)
+        lastrow = fineblockheight - 1;
+
+    for (; row <= lastrow; row++)
+    {
+        int64_t rowlo = row * size;
+        int64_t rowhi = (row + 1) * size - 1;
+        int64_t xa, xb;
+        int     col, lastcol;
+
+        // the part of the line in this row
+        rowlo = (rowlo < ylo ? ylo : (rowlo > yhi ? yhi : rowlo));
+        rowhi = (rowhi < ylo ? ylo : (rowhi > yhi ? yhi : rowhi));
+
+        if (y1 == y2)
+        {
+            xa = x1;
+            xb = x2;
+        }
+        else
+        {
+            // in double, as the product can overflow 64 bits on large maps
+            xa = x1 + (int64_t)((double)(rowlo - y1) * (x2 - x1) / (y2 - y1));
+            xb = x1 + (int64_t)((double)(rowhi - y1) * (x2 - x1) / (y2 - y1));
+        }
+
+        if (xa > xb)
+        {
+            int64_t temp = xa;
+
+            xa = xb;
+            xb = temp;
+        }
+
+        col = (xa - FRACUNIT < 0 ? 0 : (int)((xa - FRACUNIT) / size));
+        lastcol = (int)((xb + FRACUNIT) / size);
+
+        if (lastcol >= fineblockwidth)
+            lastcol = fineblockwidth - 1;
+
+        for (; col <= lastcol; col++)
+        {
+            int block = row * fineblockwidth + col;
+
+            if (positions)
+                fineblocklines[positions[block]++] = i;
+            else
+                counts[block]++;
+        }
+    }
+}
+
+//
+// P_CreateFineBlockMap
+// Creates a blockmap of lines with blocks of 64 or 32 map units if there
+// are, on average, many lines in each block of the blockmap. The lines in
+// each block are in the order of their linedef numbers. It is created from
+// the lines rather than the BLOCKMAP lump, so lines can be found in a
+// different order than the lump would give, which can change the order that
+// special lines are crossed in. It is only created while the fineblockmap
+// CVAR is on, which it isn't by default, either when the map is loaded or
+// when the CVAR is turned on. It is created at most once for each map.
+//
+void P_CreateFineBlockMap(void)
+{
+    int     total = bmapwidth * bmapheight;
+    int     numblocks = 0;
+    int     numentries = 0;
+    int     density;
+    int     *counts;
+    int     i;
+
+    if (fineblockmapcreated)
+        return;
+
+    fineblockmapcreated = true;
+
+    for (i = 0; i < total; i++)
+    {
+        const int   *list = blockmaplump + blockmap[i] + 1;
+        int         count = 0;
+
+        while (*list++ != -1)
+            count++;
+
+        if (count)
+        {
+            numblocks++;
+            numentries += count;
+        }
+    }
+
+    if (!numblocks || (density = numentries / numblocks) < 8)
+        return;
+
+    fineblockshift = (density >= 32 ? FRACBITS + 5 : FRACBITS + 6);
+    fineblockwidth = bmapwidth << (MAPBLOCKSHIFT - fineblockshift);
+    fineblockheight = bmapheight << (MAPBLOCKSHIFT - fineblockshift);
+    total = fineblockwidth * fineblockheight;
+
+    fineblockoffsets = Z_Calloc(total + 1, sizeof(*fineblockoffsets), PU_LEVEL, NULL);
+    counts = fineblockoffsets + 1;
+
+    for (i = 0; i < numlines; i++)
+        P_RasterizeFineBlockLine(i, counts, NULL);
+
+    // turn the counts into offsets
+    for (i = 0; i < total; i++)
+        fineblockoffsets[i + 1] += fineblockoffsets[i];
+
+    fineblocklines = Z_Malloc(MAX(1, fineblockoffsets[total]) * sizeof(*fineblocklines), PU_LEVEL, NULL);
+
+    {
+        int *positions = malloc(total * sizeof(*positions));
+
+        memcpy(positions, fineblockoffsets, total * sizeof(*positions));
+
+        for (i = 0; i < numlines; i++)
+            P_RasterizeFineBlockLine(i, NULL, positions);
+
+        free(positions);
+    }
+}
+
 //
 // reject overrun emulation
 //
@@ -1585,7 +1833,7 @@ static void P_LoadReject(int lumpnum, int totallines)
 //
 // P_GroupLines
 // Builds sector line lists and subsector sector numbers.
-// Finds block bounding boxes for sectors.
+// The bounding boxes of the sectors are found by P_RunGroupTasks().
 //
 // killough 5/3/98: reformatted, cleaned up
 // cph 18/8/99: rewritten to avoid O(numlines * numsectors) section
@@ -1594,11 +1842,7 @@ static void P_LoadReject(int lumpnum, int totallines)
 // cph - convenient sub-function
 static void P_AddLineToSector(line_t *li, sector_t *sector)
 {
-    fixed_t     *bbox = (void *)sector->blockbox;
-
     sector->lines[sector->linecount++] = li;
-    M_AddToBox(bbox, li->v1->x, li->v1->y);
-    M_AddToBox(bbox, li->v2->x, li->v2->y);
 }
 
 // modified to return totallines (needed by P_LoadReject)
@@ -1647,7 +1891,6 @@ static int P_GroupLines(void)
             sector->lines = linebuffer;
             linebuffer += sector->linecount;
             sector->linecount = 0;
-            M_ClearBox(sector->blockbox);
         }
     }
 
@@ -1659,14 +1902,89 @@ static int P_GroupLines(void)
             P_AddLineToSector(li, li->backsector);
     }
 
-    for (i = 0, sector = sectors; i < numsectors; i++, sector++)
+    return total;       // this value is needed by the reject overrun emulation code
+}
+
+//
+// P_FindSectorBoxes
+// Finds the bounding box and sound origin of each sector from its lines. The
+// lines are added in the order P_GroupLines() listed them, as M_AddToBox()
+// can give a different box for a different order.
+//
+static void P_FindSectorBoxes(int start, int end)
+{
+    int i;
+
+    for (i = start; i < end; i++)
     {
-        fixed_t *bbox = (void*)sector->blockbox; // cph - For convenience, so
-        int     block;                           // I can use the old code unchanged
+        sector_t    *sector = sectors + i;
+        fixed_t     *bbox = (void *)sector->blockbox;
+        int         j;
+
+        M_ClearBox(bbox);
+
+        for (j = 0; j < sector->linecount; j++)
+        {
+            line_t  *li = sector->lines[j];
+
+            M_AddToBox(bbox, li->v1->x, li->v1->y);
+            M_AddToBox(bbox, li->v2->x, li->v2->y);
+        }
 
         //e6y: fix sound origin for large levels
         sector->soundorg.x = bbox[BOXRIGHT] / 2 + bbox[BOXLEFT] / 2;
         sector->soundorg.y = bbox[BOXTOP] / 2 + bbox[BOXBOTTOM] / 2;
+    }
+}
+
+// number of sectors in each task of P_RunGroupTasks()
+#define SECTORSPERTASK  256
+
+// task 0 creates the blockmap if needed, and the others each find the boxes
+// of up to SECTORSPERTASK sectors
+static void P_RunGroupTask(int start, int end, int thread, void *data)
+{
+    int task;
+
+    for (task = start; task < end; task++)
+        if (!task)
+        {
+            if (!samelevel && blockmaprecreated)
+                P_CreateBlockMap();
+        }
+        else
+        {
+            int first = (task - 1) * SECTORSPERTASK;
+
+            P_FindSectorBoxes(first, MIN(first + SECTORSPERTASK, numsectors));
+        }
+}
+
+//
+// P_RunGroupTasks
+// Creates the blockmap if the map needs one, while finding the bounding boxes
+// of the sectors, across all threads. Neither needs the other, and both only
+// read the vertices and lines. Returns once all of them are done.
+//
+static void P_RunGroupTasks(void)
+{
+    I_ParallelFor(1 + (numsectors + SECTORSPERTASK - 1) / SECTORSPERTASK, 1, P_RunGroupTask, NULL);
+}
+
+//
+// P_SetSectorBlockBoxes
+// Changes the bounding box of each sector to the blocks of the blockmap that
+// things touching it could be in.
+//
+static void P_SetSectorBlockBoxes(void)
+{
+    sector_t    *sector;
+    int         i;
+
+    for (i = 0, sector = sectors; i < numsectors; i++, sector++)
+    {
+        fixed_t *bbox = (void*)sector->blockbox; // cph - For convenience, so
+        int     block;                           // I can use the old code unchanged
 
         // adjust bounding box to map blocks
         block = (bbox[BOXTOP] - bmaporgy + MAXRADIUS) >> MAPBLOCKSHIFT;
@@ -1685,8 +2003,6 @@ static int P_GroupLines(void)
         block = (block < 0 ? 0 : block);
         sector->blockbox[BOXLEFT] = block;
     }
-
-    return total;       // this value is needed by the reject overrun emulation code
 }
 
 //
@@ -1783,11 +2099,11 @@ static void P_RemoveSlimeTrails(void)                   // killough 10/98
 }
 
 // Precalc values for use later in long wall error fix in R_StoreWallRange()
-static void P_CalcSegsLength(void)
+static void P_CalcSegLengths(int start, int end, int thread, void *data)
 {
     int i;
 
-    for (i = 0; i < numsegs; i++)
+    for (i = start; i < end; i++)
     {
         seg_t   *li = segs + i;
         int64_t dx = (int64_t)li->v2->x - li->v1->x;
@@ -1800,6 +2116,12 @@ static void P_CalcSegsLength(void)
     }
 }
 
+// each seg only depends on its own vertices, so split them between threads
+static void P_CalcSegsLength(void)
+{
+    I_ParallelFor(numsegs, 1024, P_CalcSegLengths, NULL);
+}
+
 char            mapnum[6];
 char            maptitle[256];
 char            mapnumandtitle[512];
@@ -1963,6 +2285,8 @@ void P_SetupLevel(int ep, int map)
 {
     char        lumpname[6];
     int         lumpnum;
+    uint64_t    start = SDL_GetPerformanceCounter();
+    uint64_t    time;
 
     totalkills = totalitems = totalsecret = 0;
     wminfo.partime = 0;
@@ -1974,6 +2298,7 @@ void P_SetupLevel(int ep, int map)
 
     idclev = false;
 
+    P_StopPVS();
     Z_FreeTags(PU_LEVEL, PU_PURGELEVEL - 1);
 
     if (rejectlump != -1)
@@ -1984,6 +2309,7 @@ void P_SetupLevel(int ep, int map)
     }
 
     P_InitThinkers();
+    P_ResetTicStats();
 
     // find map name
     if (gamemode == commercial)
@@ -2034,18 +2360,25 @@ void P_SetupLevel(int ep, int map)
     }
 
     // note: most of this ordering is important
+    time = SDL_GetPerformanceCounter();
     P_LoadVertexes(lumpnum + ML_VERTEXES);
+    time = P_LoadStat(ls_vertexes, time);
     P_LoadSectors(lumpnum + ML_SECTORS);
+    time = P_LoadStat(ls_sectors, time);
     P_LoadSideDefs(lumpnum + ML_SIDEDEFS);
+    time = P_LoadStat(ls_sides, time);
     P_LoadLineDefs(lumpnum + ML_LINEDEFS);
     P_LoadSideDefs2(lumpnum + ML_SIDEDEFS);
     P_LoadLineDefs2(lumpnum + ML_LINEDEFS);
+    time = P_LoadStat(ls_lines, time);
 
     if (!samelevel)
         P_LoadBlockMap(lumpnum + ML_BLOCKMAP);
     else
         memset(blocklinks, 0, bmapwidth * bmapheight * sizeof(*blocklinks));
 
+    time = P_LoadStat(ls_blockmap, time);
+
     if (mapformat == ZDBSPX)
         P_LoadZNodes(lumpnum + ML_NODES);
     else if (mapformat == DEEPBSP)
@@ -2061,13 +2394,41 @@ void P_SetupLevel(int ep, int map)
         P_LoadSegs(lumpnum + ML_SEGS);
     }
 
+    time = P_LoadStat(ls_nodes, time);
+
     // reject loading and underflow padding separated out into new function
     // P_GroupLines modified to return a number the underflow padding needs
     P_LoadReject(lumpnum, P_GroupLines());
 
+    // a blockmap is created here rather than before the nodes are loaded, so
+    // that it can be created alongside the sectors' boxes
+    P_RunGroupTasks();
+
+    if (!samelevel)
+        P_FinishBlockMap();
+
+    P_SetSectorBlockBoxes();
+
+    fineblockmapcreated = false;
+    fineblockshift = 0;
+    fineblockoffsets = NULL;
+    fineblocklines = NULL;
+
+    if (fineblockmap)
+        P_CreateFineBlockMap();
+
+    time = P_LoadStat(ls_grouplines, time);
+
+    P_InitSight();
+    P_InitPVS(lumpnum + ML_REJECT);
+    P_InitSoundGraph();
+    time = P_LoadStat(ls_sightandsound, time);
+
     P_RemoveSlimeTrails();
+    time = P_LoadStat(ls_slimetrails, time);
 
     P_CalcSegsLength();
+    time = P_LoadStat(ls_segslength, time);
 
     r_bloodsplats_total = 0;
     memset(bloodsplats, 0, sizeof(mobj_t *) * r_bloodsplats_max);
@@ -2079,16 +2440,20 @@ void P_SetupLevel(int ep, int map)
     P_LoadThings(lumpnum + ML_THINGS);
 
     P_InitCards(&players[0]);
+    time = P_LoadStat(ls_things, time);
 
     // set up world state
     P_SpawnSpecials();
 
     P_MapEnd();
+    time = P_LoadStat(ls_specials, time);
 
     // preload graphics
     R_PrecacheLevel();
+    P_LoadStat(ls_precache, time);
 
     S_Start();
+    P_LoadStat(ls_total, start);
 }
 
 int     liquidlumps = 0;
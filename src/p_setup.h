@@ -39,7 +39,36 @@
 #if !defined(__P_SETUP__)
 #define __P_SETUP__
 
+#include "doomtype.h"
+
+enum
+{
+    ls_vertexes,
+    ls_sectors,
+    ls_sides,
+    ls_lines,
+    ls_blockmap,
+    ls_nodes,
+    ls_grouplines,
+    ls_sightandsound,
+    ls_slimetrails,
+    ls_segslength,
+    ls_things,
+    ls_specials,
+    ls_precache,
+    ls_total
+};
+
+typedef struct
+{
+    char        *name;
+    uint64_t    time;
+} loadstat_t;
+
+extern loadstat_t       loadstats[];
+
 void P_SetupLevel(int ep, int map);
+void P_CreateFineBlockMap(void);
 void P_MapName(int ep, int map);
 
 // Called by startup code.
@@ -36,8 +36,12 @@
 ========================================================================
 */
 
+#include "doomstat.h"
+#include "i_thread.h"
 #include "m_bbox.h"
 #include "p_local.h"
+#include "p_tick.h"
+#include "z_zone.h"
 
 //
 // P_CheckSight
@@ -52,9 +56,37 @@ typedef struct los_s
     fixed_t     topslope, bottomslope;  // slopes to top and bottom of target
     fixed_t     bbox[4];
     fixed_t     maxz, minz;             // cph - z optimizations for 2sided lines
+    int         *validcounts;           // lines already checked, per thread
+    int         validcount;
 } los_t;
 
-static los_t    los; // cph - made static
+//
+// Sight checks computed in parallel at the start of a tic, and the state of
+// both things when they were. A result is only used while both things and
+// all sectors remain exactly as they were, so is always the same as the
+// result of a serial check.
+//
+typedef struct
+{
+    mobj_t      *t1, *t2;
+    subsector_t *ss1, *ss2;
+    fixed_t     t1x, t1y, t1z, t1height;
+    fixed_t     t2x, t2y, t2z, t2height;
+    dboolean    result;
+} sightcheck_t;
+
+dboolean                threadedsight = threadedsight_default;
+
+void A_Chase(mobj_t *actor, player_t *player, pspdef_t *psp);
+void A_Look(mobj_t *actor, player_t *player, pspdef_t *psp);
+
+static int              *sightvalidcounts[MAXTHREADS];
+static int              sightvalidcount[MAXTHREADS];
+
+static sightcheck_t     *sightchecks;
+static int              numsightchecks;
+static int              maxsightchecks;
+static int              sightchecksectorchanges;
 
 //
 // P_DivlineSide
@@ -91,7 +123,7 @@ static fixed_t P_InterceptVector2(const divline_t *v2, const divline_t *v1)
 // Returns true
 //  if strace crosses the given subsector successfully.
 //
-static dboolean P_CrossSubsector(int num)
+static dboolean P_CrossSubsector(int num, los_t *los)
 {
     seg_t       *seg;
     int         count;
@@ -114,12 +146,12 @@ static dboolean P_CrossSubsector(int num)
     {
         line_t  *line = seg->linedef;
 
-        if (line->bbox[BOXLEFT] > los.bbox[BOXRIGHT]
-            || line->bbox[BOXRIGHT] < los.bbox[BOXLEFT]
-            || line->bbox[BOXBOTTOM] > los.bbox[BOXTOP]
-            || line->bbox[BOXTOP] < los.bbox[BOXBOTTOM])
+        if (line->bbox[BOXLEFT] > los->bbox[BOXRIGHT]
+            || line->bbox[BOXRIGHT] < los->bbox[BOXLEFT]
+            || line->bbox[BOXBOTTOM] > los->bbox[BOXTOP]
+            || line->bbox[BOXTOP] < los->bbox[BOXBOTTOM])
         {
-            line->validcount = validcount;
+            los->validcounts[line - lines] = los->validcount;
             continue;
         }
 
@@ -127,10 +159,10 @@ static dboolean P_CrossSubsector(int num)
         v2 = line->v2;
 
         // line isn't crossed?
-        if (P_DivlineSide(v1->x, v1->y, &los.strace)
-            == P_DivlineSide(v2->x, v2->y, &los.strace))
+        if (P_DivlineSide(v1->x, v1->y, &los->strace)
+            == P_DivlineSide(v2->x, v2->y, &los->strace))
         {
-            line->validcount = validcount;
+            los->validcounts[line - lines] = los->validcount;
             continue;
         }
 
@@ -140,18 +172,18 @@ static dboolean P_CrossSubsector(int num)
         divl.dy = v2->y - v1->y;
 
         // line isn't crossed?
-        if (P_DivlineSide(los.strace.x, los.strace.y, &divl)
-            == P_DivlineSide(los.t2x, los.t2y, &divl))
+        if (P_DivlineSide(los->strace.x, los->strace.y, &divl)
+            == P_DivlineSide(los->t2x, los->t2y, &divl))
         {
-            line->validcount = validcount;
+            los->validcounts[line - lines] = los->validcount;
             continue;
         }
 
         // already checked other side?
-        if (line->validcount == validcount)
+        if (los->validcounts[line - lines] == los->validcount)
             continue;
 
-        line->validcount = validcount;
+        los->validcounts[line - lines] = los->validcount;
 
         // crosses a two sided line
         front = seg->frontsector;
@@ -173,12 +205,12 @@ static dboolean P_CrossSubsector(int num)
             openbottom = MAX(front->floorheight, back->floorheight);
 
             // cph - reject if does not intrude in the z-space of the possible LOS
-            if (opentop >= los.maxz && openbottom <= los.minz)
+            if (opentop >= los->maxz && openbottom <= los->minz)
                 continue;
 
             // cph - if bottom >= top or top < minz or bottom > maxz then it must be
             // solid wrt this LOS
-            if (openbottom >= opentop || opentop < los.minz || openbottom > los.maxz)
+            if (openbottom >= opentop || opentop < los->minz || openbottom > los->maxz)
                 return false;
         }
         else
@@ -186,15 +218,15 @@ static dboolean P_CrossSubsector(int num)
 
         {
             // crosses a two sided line
-            fixed_t     frac = P_InterceptVector2(&los.strace, &divl);
+            fixed_t     frac = P_InterceptVector2(&los->strace, &divl);
 
             if (front->floorheight != back->floorheight)
-                los.bottomslope = MAX(los.bottomslope, FixedDiv(openbottom - los.sightzstart, frac));
+                los->bottomslope = MAX(los->bottomslope, FixedDiv(openbottom - los->sightzstart, frac));
 
             if (front->ceilingheight != back->ceilingheight)
-                los.topslope = MIN(los.topslope, FixedDiv(opentop - los.sightzstart, frac));
+                los->topslope = MIN(los->topslope, FixedDiv(opentop - los->sightzstart, frac));
 
-            if (los.topslope <= los.bottomslope)
+            if (los->topslope <= los->bottomslope)
                 return false;               // stop
         }
     }
@@ -208,32 +240,31 @@ static dboolean P_CrossSubsector(int num)
 // Returns true
 //  if strace crosses the given node successfully.
 //
-static dboolean P_CrossBSPNode(int bspnum)
+static dboolean P_CrossBSPNode(int bspnum, los_t *los)
 {
     while (!(bspnum & NF_SUBSECTOR))
     {
         const node_t    *bsp = nodes + bspnum;
-        int             side1 = (P_DivlineSide(los.strace.x, los.strace.y, (divline_t *)bsp) & 1);
-        int             side2 = P_DivlineSide(los.t2x, los.t2y, (divline_t *)bsp);
+        int             side1 = (P_DivlineSide(los->strace.x, los->strace.y, (divline_t *)bsp) & 1);
+        int             side2 = P_DivlineSide(los->t2x, los->t2y, (divline_t *)bsp);
 
         if (side1 == side2)
             bspnum = bsp->children[side1];              // doesn't touch the other side
         else                                            // the partition plane is crossed here
-            if (!P_CrossBSPNode(bsp->children[side1]))
+            if (!P_CrossBSPNode(bsp->children[side1], los))
                 return false;                           // cross the starting side
             else
                 bspnum = bsp->children[side1 ^ 1];      // cross the ending side
     }
-    return P_CrossSubsector((bspnum == -1 ? 0 : (bspnum & ~NF_SUBSECTOR)));
+    return P_CrossSubsector((bspnum == -1 ? 0 : (bspnum & ~NF_SUBSECTOR)), los);
 }
 
 //
-// P_CheckSight
-// Returns true
-//  if a straight line between t1 and t2 is unobstructed.
-// Uses REJECT.
+// P_CheckSightTrivial
+// Returns 0 if t1 obviously can't see t2, 1 if it obviously can, or -1 if a
+// line of sight needs to be traced between them.
 //
-dboolean P_CheckSight(mobj_t *t1, mobj_t *t2)
+static int P_CheckSightTrivial(mobj_t *t1, mobj_t *t2)
 {
     const sector_t      *s1 = t1->subsector->sector;
     const sector_t      *s2 = t2->subsector->sector;
@@ -243,7 +274,7 @@ dboolean P_CheckSight(mobj_t *t1, mobj_t *t2)
     // Determine subsector entries in REJECT table.
     // Check in REJECT table.
     if (rejectmatrix[pnum >> 3] & (1 << (pnum & 7)))
-        return false;
+        return 0;
 
     // killough 4/19/98: make fake floors and ceilings block monster view
     if ((s1->heightsec != -1 &&
@@ -256,51 +287,250 @@ dboolean P_CheckSight(mobj_t *t1, mobj_t *t2)
         t1->z >= sectors[s2->heightsec].floorheight) ||
         (t2->z >= sectors[s2->heightsec].ceilingheight &&
         t1->z + t2->height <= sectors[s2->heightsec].ceilingheight))))
-        return false;
+        return 0;
 
     // killough 11/98: shortcut for melee situations
     // same subsector? obviously visible
     if (t1->subsector == t2->subsector)
-        return true;
+        return 1;
+
+    return -1;
+}
 
+//
+// P_CheckSightTrace
+// Traces a line of sight from the eyes of t1 to any part of t2 through the BSP.
+//
+static dboolean P_CheckSightTrace(mobj_t *t1, mobj_t *t2, los_t *los)
+{
     // An unobstructed LOS is possible.
     // Now look from eyes of t1 to any part of t2.
 
-    validcount++;
+    los->sightzstart = t1->z + t1->height - (t1->height >> 2);
+    los->bottomslope = t2->z - los->sightzstart;
+    los->topslope = los->bottomslope + t2->height;
 
-    los.sightzstart = t1->z + t1->height - (t1->height >> 2);
-    los.bottomslope = t2->z - los.sightzstart;
-    los.topslope = los.bottomslope + t2->height;
+    los->strace.x = t1->x;
+    los->strace.y = t1->y;
+    los->t2x = t2->x;
+    los->t2y = t2->y;
+    los->strace.dx = t2->x - t1->x;
+    los->strace.dy = t2->y - t1->y;
 
-    los.strace.x = t1->x;
-    los.strace.y = t1->y;
-    los.t2x = t2->x;
-    los.t2y = t2->y;
-    los.strace.dx = t2->x - t1->x;
-    los.strace.dy = t2->y - t1->y;
-
-    los.bbox[BOXRIGHT] = MAX(t1->x, t2->x);
-    los.bbox[BOXLEFT] = MIN(t1->x, t2->x);
-    los.bbox[BOXTOP] = MAX(t1->y, t2->y);
-    los.bbox[BOXBOTTOM] = MIN(t1->y, t2->y);
+    los->bbox[BOXRIGHT] = MAX(t1->x, t2->x);
+    los->bbox[BOXLEFT] = MIN(t1->x, t2->x);
+    los->bbox[BOXTOP] = MAX(t1->y, t2->y);
+    los->bbox[BOXBOTTOM] = MIN(t1->y, t2->y);
 
     // cph - calculate min and max z of the potential line of sight
-    if (los.sightzstart < t2->z)
+    if (los->sightzstart < t2->z)
     {
-        los.maxz = t2->z + t2->height;
-        los.minz = los.sightzstart;
+        los->maxz = t2->z + t2->height;
+        los->minz = los->sightzstart;
     }
-    else if (los.sightzstart > t2->z + t2->height)
+    else if (los->sightzstart > t2->z + t2->height)
     {
-        los.maxz = los.sightzstart;
-        los.minz = t2->z;
+        los->maxz = los->sightzstart;
+        los->minz = t2->z;
     }
     else
     {
-        los.maxz = t2->z + t2->height;
-        los.minz = t2->z;
+        los->maxz = t2->z + t2->height;
+        los->minz = t2->z;
     }
 
     // the head node is the last node output
-    return P_CrossBSPNode(numnodes - 1);
+    return P_CrossBSPNode(numnodes - 1, los);
+}
+
+//
+// P_CheckSightLOS
+// Returns true
+//  if a straight line between t1 and t2 is unobstructed.
+// Uses REJECT. Only reads the map, so is safe to call from any thread
+// as long as los has its own validcounts.
+//
+static dboolean P_CheckSightLOS(mobj_t *t1, mobj_t *t2, los_t *los)
+{
+    int result = P_CheckSightTrivial(t1, t2);
+
+    return (result >= 0 ? result : P_CheckSightTrace(t1, t2, los));
+}
+
+//
+// P_CheckSight
+// Returns true
+//  if a straight line between t1 and t2 is unobstructed.
+// Uses REJECT.
+//
+dboolean P_CheckSight(mobj_t *t1, mobj_t *t2)
+{
+    los_t       los;
+    int         i = t1->sightcheck - 1;
+
+    // use the result computed at the start of the tic if nothing has changed since
+    if (i >= 0 && i < numsightchecks && sightchecksectorchanges == sectorchanges)
+    {
+        sightcheck_t    *check = &sightchecks[i];
+
+        if (check->t1 == t1 && check->t2 == t2
+            && check->ss1 == t1->subsector && check->ss2 == t2->subsector
+            && check->t1x == t1->x && check->t1y == t1->y
+            && check->t1z == t1->z && check->t1height == t1->height
+            && check->t2x == t2->x && check->t2y == t2->y
+            && check->t2z == t2->z && check->t2height == t2->height)
+            return check->result;
+    }
+
+    los.validcounts = sightvalidcounts[0];
+    los.validcount = ++sightvalidcount[0];
+
+    return P_CheckSightLOS(t1, t2, &los);
+}
+
+static void P_RunSightChecks(int start, int end, int thread, void *data)
+{
+    los_t       los;
+    int         i;
+
+    los.validcounts = sightvalidcounts[thread];
+
+    for (i = start; i < end; ++i)
+    {
+        sightcheck_t    *check = &sightchecks[i];
+
+        los.validcount = ++sightvalidcount[thread];
+        check->result = P_CheckSightLOS(check->t1, check->t2, &los);
+    }
+}
+
+typedef struct
+{
+    mobj_t      **things;
+    mobj_t      *target;
+    dboolean    *visible;
+} sightbatch_t;
+
+static void P_RunSightBatch(int start, int end, int thread, void *data)
+{
+    sightbatch_t    *batch = data;
+    los_t           los;
+    int             i;
+
+    los.validcounts = sightvalidcounts[thread];
+
+    for (i = start; i < end; ++i)
+    {
+        los.validcount = ++sightvalidcount[thread];
+        batch->visible[i] = P_CheckSightLOS(batch->things[i], batch->target, &los);
+    }
+}
+
+//
+// P_CheckSightBatch
+// Checks if each of count things can see target, splitting them between
+// threads if there are enough of them to be worth waking the threads for.
+// Nothing may move while this is running.
+//
+#define SIGHTBATCHMIN   32
+
+void P_CheckSightBatch(mobj_t **things, int count, mobj_t *target, dboolean *visible)
+{
+    sightbatch_t    batch;
+
+    batch.things = things;
+    batch.target = target;
+    batch.visible = visible;
+
+    if (count < SIGHTBATCHMIN)
+        P_RunSightBatch(0, count, 0, &batch);
+    else
+        I_ParallelFor(count, 4, P_RunSightBatch, &batch);
+}
+
+//
+// P_PrecomputeSight
+// Finds every monster that is about to call A_Look() or A_Chase() this
+// tic, and checks if they can see their target across all threads before
+// any of them think.
+//
+void P_PrecomputeSight(void)
+{
+    thinker_t   *th;
+    mobj_t      *playermo = players[0].mo;
+
+    numsightchecks = 0;
+
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj]; th = th->cnext)
+    {
+        mobj_t          *mo = (mobj_t *)th;
+        actionf_t       action;
+        mobj_t          *target;
+        sightcheck_t    *check;
+
+        mo->sightcheck = 0;
+
+        // only things about to change to a new state
+        if (mo->tics != 1 || mo->health <= 0 || !mo->subsector)
+            continue;
+
+        action = states[mo->state->nextstate].action;
+
+        if (action == (actionf_t)A_Look)
+        {
+            mobj_t      *soundtarget = mo->subsector->sector->soundtarget;
+
+            target = (soundtarget && (soundtarget->flags & MF_SHOOTABLE) ?
+                ((mo->flags & MF_AMBUSH) ? soundtarget : NULL) : playermo);
+        }
+        else if (action == (actionf_t)A_Chase)
+            target = (mo->target && (mo->target->flags & MF_SHOOTABLE) ? mo->target : playermo);
+        else
+            continue;
+
+        if (!target || target == mo || !target->subsector)
+            continue;
+
+        if (numsightchecks == maxsightchecks)
+        {
+            maxsightchecks = (maxsightchecks ? maxsightchecks * 2 : 256);
+            sightchecks = Z_Realloc(sightchecks, maxsightchecks * sizeof(*sightchecks));
+        }
+
+        check = &sightchecks[numsightchecks++];
+        check->t1 = mo;
+        check->t2 = target;
+        check->ss1 = mo->subsector;
+        check->ss2 = target->subsector;
+        check->t1x = mo->x;
+        check->t1y = mo->y;
+        check->t1z = mo->z;
+        check->t1height = mo->height;
+        check->t2x = target->x;
+        check->t2y = target->y;
+        check->t2z = target->z;
+        check->t2height = target->height;
+        mo->sightcheck = numsightchecks;
+    }
+
+    sightchecksectorchanges = sectorchanges;
+
+    I_ParallelFor(numsightchecks, 16, P_RunSightChecks, NULL);
+}
+
+//
+// P_InitSight
+// Called by P_SetupLevel() once the lines of a new map are loaded.
+//
+void P_InitSight(void)
+{
+    int i;
+
+    for (i = 0; i < I_GetNumThreads(); ++i)
+    {
+        sightvalidcounts[i] = Z_Calloc(numlines, sizeof(int), PU_LEVEL, NULL);
+        sightvalidcount[i] = 0;
+    }
+
+    numsightchecks = 0;
 }
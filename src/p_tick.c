@@ -39,12 +39,45 @@
 #include "c_console.h"
 #include "doomstat.h"
 #include "p_local.h"
+#include "p_pvs.h"
 #include "p_tick.h"
+#include "SDL.h"
 #include "z_zone.h"
 
 int     leveltime;
 int     stat_time = 0;
 
+dboolean        ticstats = false;
+int             ticstattics = 0;
+
+// upper bounds of each histogram bucket, in microseconds
+int             ticstatbuckets[TICSTATBUCKETS - 1] = { 100, 500, 1000, 5000 };
+
+ticstat_t ticstat[] =
+{
+    { "P_PlayerThink",     NULL,                0, 0, 0, 0, { 0 } },
+    { "P_PrecomputeSight", NULL,                0, 0, 0, 0, { 0 } },
+    { "P_RunThinkers",     NULL,                0, 0, 0, 0, { 0 } },
+    { "P_UpdateSpecials",  NULL,                0, 0, 0, 0, { 0 } },
+    { "Total",             NULL,                0, 0, 0, 0, { 0 } },
+
+    // thinkers
+    { "P_MobjThinker",     P_MobjThinker,       0, 0, 0, 0, { 0 } },
+    { "T_MoveCeiling",     T_MoveCeiling,       0, 0, 0, 0, { 0 } },
+    { "T_VerticalDoor",    T_VerticalDoor,      0, 0, 0, 0, { 0 } },
+    { "T_MoveFloor",       T_MoveFloor,         0, 0, 0, 0, { 0 } },
+    { "T_MoveElevator",    T_MoveElevator,      0, 0, 0, 0, { 0 } },
+    { "T_PlatRaise",       T_PlatRaise,         0, 0, 0, 0, { 0 } },
+    { "T_LightFlash",      T_LightFlash,        0, 0, 0, 0, { 0 } },
+    { "T_StrobeFlash",     T_StrobeFlash,       0, 0, 0, 0, { 0 } },
+    { "T_Glow",            T_Glow,              0, 0, 0, 0, { 0 } },
+    { "T_FireFlicker",     T_FireFlicker,       0, 0, 0, 0, { 0 } },
+    { "T_Scroll",          T_Scroll,            0, 0, 0, 0, { 0 } },
+    { "T_Pusher",          T_Pusher,            0, 0, 0, 0, { 0 } },
+    { "Other",             NULL,                0, 0, 0, 0, { 0 } },
+    { "",                  NULL,                0, 0, 0, 0, { 0 } }
+};
+
 //
 // THINKERS
 // All thinkers should be allocated by Z_Malloc
@@ -225,6 +258,131 @@ static void P_RunThinkers(void)
     }
 }
 
+//
+// P_ResetTicStats
+//
+void P_ResetTicStats(void)
+{
+    int i = 0;
+
+    while (ticstat[i].name[0])
+    {
+        ticstat[i].time = 0;
+        ticstat[i].totaltime = 0;
+        ticstat[i].maxtime = 0;
+        ticstat[i].count = 0;
+        memset(ticstat[i].histogram, 0, sizeof(ticstat[i].histogram));
+        ++i;
+    }
+    ticstattics = 0;
+}
+
+static ticstat_t *P_FindTicStat(think_t function)
+{
+    ticstat_t   *stat = &ticstat[ts_firstthinker];
+
+    while (stat->function)
+    {
+        if (stat->function == function)
+            break;
+        ++stat;
+    }
+    return stat;
+}
+
+//
+// P_RunThinkersProfiled
+//
+// Same as P_RunThinkers(), but with the time spent in each thinker
+// accumulated against its function.
+//
+static void P_RunThinkersProfiled(void)
+{
+    currentthinker = thinkercap.next;
+
+    while (currentthinker != &thinkercap)
+    {
+        think_t function = currentthinker->function;
+
+        if (function && function != P_RemoveThinkerDelayed)
+        {
+            uint64_t    start = SDL_GetPerformanceCounter();
+            ticstat_t   *stat;
+
+            function(currentthinker);
+            stat = P_FindTicStat(function);
+            stat->time += SDL_GetPerformanceCounter() - start;
+            stat->count++;
+            ticstat[ts_runthinkers].count++;
+        }
+        else if (function)
+            function(currentthinker);
+        currentthinker = currentthinker->next;
+    }
+}
+
+static void P_UpdateTicStat(ticstat_t *stat, uint64_t frequency)
+{
+    int         i = 0;
+    uint64_t    us = stat->time * 1000000 / frequency;
+
+    while (i < TICSTATBUCKETS - 1 && us >= (uint64_t)ticstatbuckets[i])
+        ++i;
+    stat->histogram[i]++;
+
+    stat->totaltime += stat->time;
+    if (stat->time > stat->maxtime)
+        stat->maxtime = stat->time;
+    stat->time = 0;
+}
+
+//
+// P_ProfiledTic
+//
+// Runs the same tic as P_Ticker(), timing each stage.
+//
+static void P_ProfiledTic(void)
+{
+    uint64_t    frequency = SDL_GetPerformanceFrequency();
+    uint64_t    start = SDL_GetPerformanceCounter();
+    uint64_t    time;
+    int         i;
+
+    P_PlayerThink(&players[0]);
+
+    time = SDL_GetPerformanceCounter();
+    ticstat[ts_playerthink].time = time - start;
+    ticstat[ts_playerthink].count++;
+
+    if (threadedsight)
+    {
+        P_PrecomputeSight();
+
+        ticstat[ts_precomputesight].time = SDL_GetPerformanceCounter() - time;
+        ticstat[ts_precomputesight].count++;
+        time = SDL_GetPerformanceCounter();
+    }
+
+    P_RunThinkersProfiled();
+
+    ticstat[ts_runthinkers].time = SDL_GetPerformanceCounter() - time;
+    time = SDL_GetPerformanceCounter();
+
+    P_UpdateSpecials();
+
+    ticstat[ts_updatespecials].time = SDL_GetPerformanceCounter() - time;
+    ticstat[ts_updatespecials].count++;
+    ticstat[ts_total].time = SDL_GetPerformanceCounter() - start;
+    ticstat[ts_total].count++;
+
+    // only tics in which a stage actually ran count towards its histogram
+    for (i = 0; ticstat[i].name[0]; ++i)
+        if (ticstat[i].time)
+            P_UpdateTicStat(&ticstat[i], frequency);
+
+    ++ticstattics;
+}
+
 //
 // P_Ticker
 //
@@ -234,10 +392,20 @@ void P_Ticker(void)
     if (paused || menuactive || consoleactive)
         return;
 
-    P_PlayerThink(&players[0]);
+    P_UpdatePVS();
 
-    P_RunThinkers();
-    P_UpdateSpecials();
+    if (ticstats)
+        P_ProfiledTic();
+    else
+    {
+        P_PlayerThink(&players[0]);
+
+        if (threadedsight)
+            P_PrecomputeSight();
+
+        P_RunThinkers();
+        P_UpdateSpecials();
+    }
 
     P_MapEnd();
 
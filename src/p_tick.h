@@ -70,4 +70,35 @@ extern thinker_t        thinkerclasscap[];
 
 #define thinkercap      thinkerclasscap[th_all]
 
+// Tic profiling, reported by the ticstats console command
+#define TICSTATBUCKETS  5
+
+typedef struct
+{
+    char                *name;
+    think_t             function;
+    uint64_t            time;
+    uint64_t            totaltime;
+    uint64_t            maxtime;
+    uint64_t            count;
+    int                 histogram[TICSTATBUCKETS];
+} ticstat_t;
+
+enum
+{
+    ts_playerthink,
+    ts_precomputesight,
+    ts_runthinkers,
+    ts_updatespecials,
+    ts_total,
+    ts_firstthinker
+};
+
+extern dboolean         ticstats;
+extern int              ticstattics;
+extern ticstat_t        ticstat[];
+extern int              ticstatbuckets[TICSTATBUCKETS - 1];
+
+void P_ResetTicStats(void);
+
 #endif
@@ -41,10 +41,12 @@
 #include "doomstat.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_tinttab.h"
 #include "m_misc.h"
 #include "p_local.h"
 #include "p_tick.h"
 #include "r_sky.h"
+#include "SDL.h"
 #include "w_wad.h"
 #include "z_zone.h"
 
@@ -74,7 +76,7 @@ int             numspritelumps;
 
 int             numtextures;
 texture_t       **textures;
-texture_t       **textures_hashtable;
+static namehash_t   textureshash;
 
 int             *texturewidthmask;
 
@@ -518,13 +520,12 @@ static void GenerateTextureHashTable(void)
 {
     int i;
 
-    textures_hashtable = Z_Calloc(numtextures, sizeof(texture_t *), PU_STATIC, 0);
+    W_InitNameHash(&textureshash, numtextures);
 
     // Add all textures to hash table
     for (i = 0; i < numtextures; ++i)
     {
-        texture_t       **rover;
-        int             key;
+        int     *slot = W_NameHashSlot(&textureshash, W_LumpNameKey(textures[i]->name));
 
         // Store index
         textures[i]->index = i;
@@ -532,18 +533,9 @@ static void GenerateTextureHashTable(void)
         // Vanilla DOOM does a linear search of the textures array
         // and stops at the first entry it finds. If there are two
         // entries with the same name, the first one in the array
-        // wins. The new entry must therefore be added at the end
-        // of the hash chain, so that earlier entries win.
-        key = W_LumpNameHash(textures[i]->name) % numtextures;
-
-        rover = &textures_hashtable[key];
-
-        while (*rover)
-            rover = &(*rover)->next;
-
-        // Hook into hash table
-        textures[i]->next = NULL;
-        *rover = textures[i];
+        // wins, so only add the first one.
+        if (*slot == -1)
+            *slot = i;
     }
 }
 
@@ -952,15 +944,13 @@ void R_InitSpriteLumps(void)
 //
 // killough 4/4/98: Add support for C_START/C_END markers
 //
-extern int FindNearestColor(byte *palette, int red, int green, int blue);
-
 byte grays[256];
 
 void R_InitColormaps(void)
 {
     dboolean    COLORMAP = (W_CheckMultipleLumps("COLORMAP") > 1);
     int         i;
-    byte        *palsrc, *palette;
+    byte        *palsrc;
     wad_file_t  *colormapwad;
 
     if (W_CheckNumForName("C_START") >= 0 && W_CheckNumForName("C_END") >= 0)
@@ -994,7 +984,7 @@ void R_InitColormaps(void)
     // offending code from dcolor.c, corrected it, put it here, and now colormap
     // 32 is manually calculated rather than grabbing it from the colormap lump.
     // The resulting differences are minor.
-    palsrc = palette = W_CacheLumpName("PLAYPAL", PU_CACHE);
+    palsrc = W_CacheLumpName("PLAYPAL", PU_CACHE);
 
     for (i = 0; i < 255; i++)
     {
@@ -1003,13 +993,13 @@ void R_InitColormaps(void)
         float       blue = *palsrc++ / 256.0f;
         float       gray = red * 0.299f + green * 0.587f + blue * 0.114f/*0.144f*/;
 
-        grays[i] = FindNearestColor(palette, (int)(gray * 255.0f),
-            (int)(gray * 255.0f), (int)(gray * 255.0f));
+        grays[i] = I_FindNearestColor((int)(gray * 255.0f), (int)(gray * 255.0f),
+            (int)(gray * 255.0f));
 
         if (!COLORMAP)
         {
             gray = (1.0f - gray) * 255.0f;
-            colormaps[0][32 * 256 + i] = FindNearestColor(palette, (int)gray, (int)gray, (int)gray);
+            colormaps[0][32 * 256 + i] = I_FindNearestColor((int)gray, (int)gray, (int)gray);
         }
     }
 }
@@ -1067,13 +1057,9 @@ int R_FlatNumForName(char *name)
 //
 int R_CheckFlatNumForName(char *name)
 {
-    int i;
-
-    for (i = firstflat; i <= lastflat; i++)
-        if (!strncasecmp(lumpinfo[i]->name, name, 8))
-            return (i - firstflat);
+    int i = W_RangeCheckNumForName(firstflat, lastflat, name);
 
-    return -1;
+    return (i == -1 ? -1 : i - firstflat);
 }
 
 //
@@ -1083,26 +1069,11 @@ int R_CheckFlatNumForName(char *name)
 //
 int R_CheckTextureNumForName(char *name)
 {
-    texture_t   *texture;
-    int         key;
-
     // "NoTexture" marker.
     if (name[0] == '-')
         return 0;
 
-    key = W_LumpNameHash(name) % numtextures;
-
-    texture = textures_hashtable[key];
-
-    while (texture)
-    {
-        if (!strncasecmp(texture->name, name, 8))
-            return texture->index;
-
-        texture = texture->next;
-    }
-
-    return -1;
+    return W_NameHashFind(&textureshash, W_LumpNameKey(name));
 }
 
 //
@@ -1122,41 +1093,92 @@ int R_TextureNumForName(char *name)
     return i;
 }
 
+typedef struct
+{
+    int         lump;
+    int         distance;
+} precachelump_t;
+
+static precachelump_t   *precachelumps;
+static int              numprecachelumps;
+static int              precachelumpsdone;
+
+#define PRECACHEDISTANCE    1024    // load lumps needed this close before the level starts
+#define PRECACHETICTIME     1000    // microseconds spent loading the rest each tic
+
+static int R_ComparePrecacheLumps(const void *a, const void *b)
+{
+    const precachelump_t    *lump1 = a;
+    const precachelump_t    *lump2 = b;
+
+    return (lump1->distance != lump2->distance ? lump1->distance - lump2->distance :
+        lump1->lump - lump2->lump);
+}
+
+static void R_AddPrecacheLump(int *distances, int lump, int distance)
+{
+    if (distance < distances[lump])
+        distances[lump] = distance;
+}
+
 //
 // R_PrecacheLevel
-// Preloads all relevant graphics for the level.
+// Preloads all relevant graphics for the level. Those nearest the player
+// are loaded straight away, and the rest a little at a time each tic by
+// R_PrecacheTic(), nearest first, so the level can start without waiting
+// for them all.
 //
 void R_PrecacheLevel(void)
 {
-    byte        *hitlist;
+    int         *distances = malloc(numlumps * sizeof(*distances));
     thinker_t   *th;
+    mobj_t      *mo = players[0].mo;
+    fixed_t     x = (mo ? mo->x : 0);
+    fixed_t     y = (mo ? mo->y : 0);
     int         i;
     int         j;
     int         k;
 
-    hitlist = malloc(MAX(numtextures, MAX(numflats, numsprites)));
+    free(precachelumps);
+    precachelumps = NULL;
+    numprecachelumps = 0;
+    precachelumpsdone = 0;
 
-    // Precache flats.
-    memset(hitlist, 0, numflats);
+    for (i = 0; i < numlumps; i++)
+        distances[i] = INT_MAX;
 
+    // Precache flats.
     for (i = 0; i < numsectors; i++)
     {
-        hitlist[sectors[i].floorpic] = 1;
-        hitlist[sectors[i].ceilingpic] = 1;
-    }
+        sector_t    *sector = &sectors[i];
+        int         distance = P_ApproxDistance(sector->soundorg.x - x, sector->soundorg.y - y) >> FRACBITS;
 
-    for (i = 0; i < numflats; i++)
-        if (hitlist[i])
-            W_CacheLumpNum(firstflat + i, PU_CACHE);
+        R_AddPrecacheLump(distances, firstflat + sector->floorpic, distance);
+        R_AddPrecacheLump(distances, firstflat + sector->ceilingpic, distance);
+    }
 
     // Precache textures.
-    memset(hitlist, 0, numtextures);
-
     for (i = 0; i < numsides; i++)
     {
-        hitlist[sides[i].toptexture] = 1;
-        hitlist[sides[i].midtexture] = 1;
-        hitlist[sides[i].bottomtexture] = 1;
+        side_t      *side = &sides[i];
+        sector_t    *sector = side->sector;
+        int         distance = P_ApproxDistance(sector->soundorg.x - x, sector->soundorg.y - y) >> FRACBITS;
+        texture_t   *texture;
+
+        texture = textures[side->toptexture];
+
+        for (j = 0; j < texture->patchcount; j++)
+            R_AddPrecacheLump(distances, texture->patches[j].patch, distance);
+
+        texture = textures[side->midtexture];
+
+        for (j = 0; j < texture->patchcount; j++)
+            R_AddPrecacheLump(distances, texture->patches[j].patch, distance);
+
+        texture = textures[side->bottomtexture];
+
+        for (j = 0; j < texture->patchcount; j++)
+            R_AddPrecacheLump(distances, texture->patches[j].patch, distance);
     }
 
     // Sky texture is always present.
@@ -1165,32 +1187,62 @@ void R_PrecacheLevel(void)
     //  while the sky texture is stored like
     //  a wall texture, with an episode dependent
     //  name.
-    hitlist[skytexture] = 1;
+    for (j = 0; j < textures[skytexture]->patchcount; j++)
+        R_AddPrecacheLump(distances, textures[skytexture]->patches[j].patch, 0);
 
-    for (i = 0; i < numtextures; i++)
-        if (hitlist[i])
+    // Precache sprites.
+    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj]; th = th->cnext)
+    {
+        mobj_t          *thing = (mobj_t *)th;
+        int             distance = P_ApproxDistance(thing->x - x, thing->y - y) >> FRACBITS;
+        spritedef_t     *sprite = &sprites[thing->sprite];
+
+        for (j = 0; j < sprite->numframes; j++)
         {
-            texture_t       *texture = textures[i];
+            short   *lump = sprite->spriteframes[j].lump;
 
-            for (j = 0; j < texture->patchcount; j++)
-                W_CacheLumpNum(texture->patches[j].patch, PU_CACHE);
+            for (k = 0; k < 8; k++)
+                if (lump[k] >= 0)
+                    R_AddPrecacheLump(distances, firstspritelump + lump[k], distance);
         }
+    }
 
-    // Precache sprites.
-    memset(hitlist, 0, numsprites);
+    for (i = 0; i < numlumps; i++)
+        if (distances[i] != INT_MAX)
+            numprecachelumps++;
 
-    for (th = thinkerclasscap[th_mobj].cnext; th != &thinkerclasscap[th_mobj]; th = th->cnext)
-        hitlist[((mobj_t *)th)->sprite] = 1;
+    precachelumps = malloc(numprecachelumps * sizeof(*precachelumps));
 
-    for (i = 0; i < numsprites; i++)
-        if (hitlist[i])
-            for (j = 0; j < sprites[i].numframes; j++)
-            {
-                short   *lump = sprites[i].spriteframes[j].lump;
+    for (i = 0, j = 0; i < numlumps; i++)
+        if (distances[i] != INT_MAX)
+        {
+            precachelumps[j].lump = i;
+            precachelumps[j++].distance = distances[i];
+        }
 
-                for (k = 0; k < 8; k++)
-                    W_CacheLumpNum(firstspritelump + lump[k], PU_CACHE);
-            }
+    free(distances);
+
+    qsort(precachelumps, numprecachelumps, sizeof(*precachelumps), R_ComparePrecacheLumps);
+
+    while (precachelumpsdone < numprecachelumps
+        && precachelumps[precachelumpsdone].distance < PRECACHEDISTANCE)
+        W_PrecacheLumpNum(precachelumps[precachelumpsdone++].lump, PU_CACHE);
+}
+
+//
+// R_PrecacheTic
+// Preloads more of the graphics R_PrecacheLevel() didn't have time to.
+//
+void R_PrecacheTic(void)
+{
+    uint64_t    end;
+
+    if (precachelumpsdone >= numprecachelumps)
+        return;
+
+    end = SDL_GetPerformanceCounter() + SDL_GetPerformanceFrequency() * PRECACHETICTIME / 1000000;
 
-    free(hitlist);
+    do
+        W_PrecacheLumpNum(precachelumps[precachelumpsdone++].lump, PU_CACHE);
+    while (precachelumpsdone < numprecachelumps && SDL_GetPerformanceCounter() < end);
 }
@@ -113,9 +113,6 @@ struct texture_s
     // Index in textures list
     int         index;
 
-    // Next in hash table chain
-    texture_t   *next;
-
     // All the patches[patchcount]
     //  are drawn back to front into the cached texture.
     short       patchcount;
@@ -128,6 +125,7 @@ byte *R_GetColumn(int tex, int col, dboolean opaque);
 // I/O, setting up the stuff.
 void R_InitData(void);
 void R_PrecacheLevel(void);
+void R_PrecacheTic(void);
 
 // Retrieval.
 // Floor/ceiling opaque texture tiles,
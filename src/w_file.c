@@ -37,12 +37,15 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "doomtype.h"
 #include "m_argv.h"
+#include "m_misc.h"
 #include "w_file.h"
 
 extern wad_file_class_t stdc_wad_file;
+extern wad_file_class_t zip_wad_file;
 
 #if defined(WIN32)
 extern wad_file_class_t win32_wad_file;
@@ -68,24 +71,34 @@ wad_file_t *W_OpenFile(char *path)
     wad_file_t  *result;
     int         i;
 
+    // PK3 files are compressed, so always need their own class
+    if (strlen(path) > 4 && M_StringCompare(path + strlen(path) - 4, ".pk3"))
+        return zip_wad_file.OpenFile(path);
+
     //!
     // Use the OS's virtual memory subsystem to map WAD files
     // directly into memory.
     //
     if (!M_CheckParm("-mmap"))
-        return stdc_wad_file.OpenFile(path);
-
-    // Try all classes in order until we find one that works
-    result = NULL;
-
-    for (i = 0; i < arrlen(wad_file_classes); ++i)
+        result = stdc_wad_file.OpenFile(path);
+    else
     {
-        result = wad_file_classes[i]->OpenFile(path);
+        // Try all classes in order until we find one that works
+        result = NULL;
+
+        for (i = 0; i < arrlen(wad_file_classes); ++i)
+        {
+            result = wad_file_classes[i]->OpenFile(path);
 
-        if (result)
-            break;
+            if (result)
+                break;
+        }
     }
 
+    // W_AddFile() works out if it's an IWAD or PWAD
+    if (result)
+        result->type = 0;
+
     return result;
 }
 
@@ -98,3 +111,9 @@ size_t W_Read(wad_file_t *wad, unsigned int offset, void *buffer, size_t buffer_
 {
     return wad->file_class->Read(wad, offset, buffer, buffer_len);
 }
+
+void W_Prefetch(wad_file_t *wad, unsigned int offset, size_t length)
+{
+    if (wad->file_class->Prefetch)
+        wad->file_class->Prefetch(wad, offset, length);
+}
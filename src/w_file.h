@@ -55,6 +55,10 @@ typedef struct
     // Read data from the specified position in the file into the
     // provided buffer. Returns the number of bytes read.
     size_t (*Read)(wad_file_t *file, unsigned int offset, void *buffer, size_t buffer_len);
+
+    // Start reading part of a mapped file into memory in the background.
+    // May be NULL.
+    void (*Prefetch)(wad_file_t *file, unsigned int offset, size_t length);
 } wad_file_class_t;
 
 struct _wad_file_s
@@ -76,6 +80,14 @@ struct _wad_file_s
     int                 type;
 };
 
+// A lump in a PK3 file, at its position in the file's decompressed contents.
+typedef struct
+{
+    char            name[8];
+    unsigned int    position;
+    unsigned int    size;
+} ziplump_t;
+
 // Open the specified file. Returns a pointer to a new wad_file_t
 // handle for the WAD file, or NULL if it could not be opened.
 wad_file_t *W_OpenFile(char *path);
@@ -88,4 +100,13 @@ void W_CloseFile(wad_file_t *wad);
 // Returns the number of bytes read.
 size_t W_Read(wad_file_t *wad, unsigned int offset, void *buffer, size_t buffer_len);
 
+// Returns the number of lumps in the specified PK3 file, including those in
+// any WADs in its maps folder, and a list of them in lumps that should be
+// freed with Z_Free().
+int W_GetZipLumps(wad_file_t *wad, ziplump_t **lumps);
+
+// Start reading part of the specified WAD file into memory, if it is
+// mapped and the OS supports it.
+void W_Prefetch(wad_file_t *wad, unsigned int offset, size_t length);
+
 #endif
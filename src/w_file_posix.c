@@ -69,7 +69,9 @@ static void MapFile(posix_wad_file_t *wad)
     protection = PROT_READ|PROT_WRITE;
 
     // Writes to the mapped area result in private changes that are
-    // *not* written to disk.
+    // *not* written to disk. Only the pages that are written to are
+    // copied, so the rest are shared with the page cache as if the
+    // mapping was read-only.
 
     flags = MAP_PRIVATE;
 
@@ -77,7 +79,7 @@ static void MapFile(posix_wad_file_t *wad)
                   protection, flags,
                   wad->handle, 0);
 
-    wad->wad.mapped = result;
+    wad->wad.mapped = (result == MAP_FAILED ? NULL : result);
 }
 
 unsigned int GetFileLength(int handle)
@@ -116,6 +118,8 @@ static void W_POSIX_CloseFile(wad_file_t *wad)
     posix_wad = (posix_wad_file_t *) wad;
 
     // If mapped, unmap it.
+    if (wad->mapped)
+        munmap(wad->mapped, wad->length);
 
     // Close the file
     close(posix_wad->handle);
@@ -132,16 +136,14 @@ size_t W_POSIX_Read(wad_file_t *wad, unsigned int offset, void *buffer, size_t b
 
     posix_wad = (posix_wad_file_t *) wad;
 
-    // Jump to the specified position in the file.
-    lseek(posix_wad->handle, offset, SEEK_SET);
-
-    // Read into the buffer.
+    // Read into the buffer from the specified position in the file,
+    // without moving the file pointer.
     bytes_read = 0;
     byte_buffer = buffer;
 
     while (buffer_len > 0)
     {
-        int     result = read(posix_wad->handle, byte_buffer, buffer_len);
+        ssize_t result = pread(posix_wad->handle, byte_buffer, buffer_len, offset + bytes_read);
 
         if (result < 0)
         {
@@ -160,11 +162,30 @@ size_t W_POSIX_Read(wad_file_t *wad, unsigned int offset, void *buffer, size_t b
     return bytes_read;
 }
 
+// Ask the OS to start reading part of a mapped file into memory, so it
+// is already there by the time it is needed.
+static void W_POSIX_Prefetch(wad_file_t *wad, unsigned int offset, size_t length)
+{
+    static size_t   pagesize;
+    size_t          start;
+
+    if (!wad->mapped || !length)
+        return;
+
+    if (!pagesize)
+        pagesize = sysconf(_SC_PAGESIZE);
+
+    // madvise() needs an address on a page boundary
+    start = offset & ~(pagesize - 1);
+    madvise(wad->mapped + start, offset + length - start, MADV_WILLNEED);
+}
+
 wad_file_class_t posix_wad_file =
 {
     W_POSIX_OpenFile,
     W_POSIX_CloseFile,
-    W_POSIX_Read
+    W_POSIX_Read,
+    W_POSIX_Prefetch
 };
 
 #endif
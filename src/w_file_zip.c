@@ -0,0 +1,923 @@
+/*
+========================================================================
+
+                           D O O M  R e t r o
+         The classic, refined DOOM source port. For Windows PC.
+
+========================================================================
+
+  Copyright  1993-2012 id Software LLC, a ZeniMax Media company.
+  Copyright  2013-2016 Brad Harding.
+
+  DOOM Retro is a fork of Chocolate DOOM.
+  For a list of credits, see the accompanying AUTHORS file.
+
+  This file is part of DOOM Retro.
+
+  DOOM Retro is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation, either version 3 of the License, or (at your
+  option) any later version.
+
+  DOOM Retro is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with DOOM Retro. If not, see <http://www.gnu.org/licenses/>.
+
+  DOOM is a registered trademark of id Software LLC, a ZeniMax Media
+  company, in the US and/or other countries and is used without
+  permission. All other trademarks are the property of their respective
+  holders. DOOM Retro is in no way affiliated with nor endorsed by
+  id Software.
+
+========================================================================
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c_console.h"
+#include "m_fixed.h"
+#include "m_misc.h"
+#include "w_file.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+//
+// PK3 (ZIP) files are read as if they were one long file made up of all of
+// their lumps decompressed one after another. Each lump is decompressed
+// from the file as it is read, so only the lumps that are actually cached
+// are ever decompressed. The lumps of a map in a WAD in the maps folder are
+// read from inside that WAD.
+//
+
+#define ZIP_LOCALHEADER         0x04034B50
+#define ZIP_CENTRALHEADER       0x02014B50
+#define ZIP_ENDOFCENTRALDIR     0x06054B50
+
+#define ZIP_STORED              0
+#define ZIP_DEFLATED            8
+
+enum
+{
+    ns_global,
+    ns_flats,
+    ns_sprites,
+    ns_maps,
+    NUMNAMESPACES
+};
+
+typedef struct
+{
+    ziplump_t       lump;
+    unsigned int    localheader;
+    int             dataoffset;         // -1 until the local header is read
+    unsigned int    compressedsize;
+    int             method;
+    int             ns;
+} zipentry_t;
+
+typedef struct
+{
+    wad_file_t      wad;
+    FILE            *fstream;
+    zipentry_t      *entries;
+    int             numentries;
+
+    // last lump decompressed for a partial read
+    int             lastentry;
+    byte            *lastdata;
+} zip_wad_file_t;
+
+extern wad_file_class_t zip_wad_file;
+
+static unsigned int ReadShort(const byte *p)
+{
+    return (p[0] | (p[1] << 8));
+}
+
+static unsigned int ReadLong(const byte *p)
+{
+    return (p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24));
+}
+
+//
+// INFLATE
+// A small decoder for the deflate format used by ZIP files (RFC 1951).
+//
+
+#define MAXBITS     15
+#define MAXLCODES   286
+#define MAXDCODES   30
+#define FIXLCODES   288
+
+typedef struct
+{
+    short       count[MAXBITS + 1];
+    short       symbol[FIXLCODES];
+} huffman_t;
+
+typedef struct
+{
+    const byte  *in;
+    size_t      inlen;
+    size_t      inpos;
+    unsigned int bitbuf;
+    int         bitcount;
+
+    byte        *out;
+    size_t      outlen;
+    size_t      outpos;
+
+    dboolean    error;
+} inflate_t;
+
+static int InflateBits(inflate_t *s, int need)
+{
+    unsigned int    val = s->bitbuf;
+
+    while (s->bitcount < need)
+    {
+        if (s->inpos == s->inlen)
+        {
+            s->error = true;
+            return 0;
+        }
+
+        val |= (unsigned int)s->in[s->inpos++] << s->bitcount;
+        s->bitcount += 8;
+    }
+
+    s->bitbuf = val >> need;
+    s->bitcount -= need;
+
+    return (val & ((1 << need) - 1));
+}
+
+static dboolean InflateStored(inflate_t *s)
+{
+    unsigned int    len;
+
+    // discard leftover bits from the current byte
+    s->bitbuf = 0;
+    s->bitcount = 0;
+
+    if (s->inpos + 4 > s->inlen)
+        return false;
+
+    len = ReadShort(s->in + s->inpos);
+
+    if (ReadShort(s->in + s->inpos + 2) != (~len & 0xFFFF))
+        return false;
+
+    s->inpos += 4;
+
+    if (s->inpos + len > s->inlen || s->outpos + len > s->outlen)
+        return false;
+
+    memcpy(s->out + s->outpos, s->in + s->inpos, len);
+    s->inpos += len;
+    s->outpos += len;
+
+    return true;
+}
+
+// Decodes a symbol using the canonical Huffman code in h, one bit at a time.
+static int InflateDecode(inflate_t *s, const huffman_t *h)
+{
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    int len;
+
+    for (len = 1; len <= MAXBITS; len++)
+    {
+        int count;
+
+        code |= InflateBits(s, 1);
+
+        if (s->error)
+            return -1;
+
+        count = h->count[len];
+
+        if (code - count < first)
+            return h->symbol[index + (code - first)];
+
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+// Builds a canonical Huffman code from the code lengths of n symbols.
+// Returns 0 if the code is complete, > 0 if it is incomplete, or < 0 if it
+// is over-subscribed.
+static int InflateConstruct(huffman_t *h, const short *length, int n)
+{
+    short   offs[MAXBITS + 1];
+    int     left = 1;
+    int     len;
+    int     symbol;
+
+    for (len = 0; len <= MAXBITS; len++)
+        h->count[len] = 0;
+
+    for (symbol = 0; symbol < n; symbol++)
+        h->count[length[symbol]]++;
+
+    if (h->count[0] == n)
+        return 0;
+
+    for (len = 1; len <= MAXBITS; len++)
+    {
+        left <<= 1;
+        left -= h->count[len];
+
+        if (left < 0)
+            return left;
+    }
+
+    offs[1] = 0;
+
+    for (len = 1; len < MAXBITS; len++)
+        offs[len + 1] = offs[len] + h->count[len];
+
+    for (symbol = 0; symbol < n; symbol++)
+        if (length[symbol])
+            h->symbol[offs[length[symbol]]++] = symbol;
+
+    return left;
+}
+
+static dboolean InflateCodes(inflate_t *s, const huffman_t *lencode, const huffman_t *distcode)
+{
+    static const short  lbase[29] =
+    {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+
+    static const short  lext[29] =
+    {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+
+    static const short  dbase[30] =
+    {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+
+    static const short  dext[30] =
+    {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+
+    while (true)
+    {
+        int symbol = InflateDecode(s, lencode);
+
+        if (symbol < 0)
+            return false;
+
+        if (symbol < 256)
+        {
+            // literal
+            if (s->outpos == s->outlen)
+                return false;
+
+            s->out[s->outpos++] = symbol;
+        }
+        else if (symbol == 256)
+            return true;
+        else
+        {
+            // length and distance of a match
+            size_t  len;
+            size_t  dist;
+
+            symbol -= 257;
+
+            if (symbol >= 29)
+                return false;
+
+            len = lbase[symbol] + InflateBits(s, lext[symbol]);
+            symbol = InflateDecode(s, distcode);
+
+            if (symbol < 0 || symbol >= 30)
+                return false;
+
+            dist = dbase[symbol] + InflateBits(s, dext[symbol]);
+
+            if (s->error || dist > s->outpos || s->outpos + len > s->outlen)
+                return false;
+
+            while (len--)
+            {
+                s->out[s->outpos] = s->out[s->outpos - dist];
+                s->outpos++;
+            }
+        }
+    }
+}
+
+static dboolean InflateFixed(inflate_t *s)
+{
+    static huffman_t    lencode;
+    static huffman_t    distcode;
+    static dboolean     built;
+
+    if (!built)
+    {
+        short   lengths[FIXLCODES];
+        int     symbol;
+
+        for (symbol = 0; symbol < 144; symbol++)
+            lengths[symbol] = 8;
+
+        for (; symbol < 256; symbol++)
+            lengths[symbol] = 9;
+
+        for (; symbol < 280; symbol++)
+            lengths[symbol] = 7;
+
+        for (; symbol < FIXLCODES; symbol++)
+            lengths[symbol] = 8;
+
+        InflateConstruct(&lencode, lengths, FIXLCODES);
+
+        for (symbol = 0; symbol < MAXDCODES; symbol++)
+            lengths[symbol] = 5;
+
+        InflateConstruct(&distcode, lengths, MAXDCODES);
+        built = true;
+    }
+
+    return InflateCodes(s, &lencode, &distcode);
+}
+
+static dboolean InflateDynamic(inflate_t *s)
+{
+    static const short  order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    short               lengths[MAXLCODES + MAXDCODES];
+    huffman_t           lencode;
+    huffman_t           distcode;
+    int                 nlen = InflateBits(s, 5) + 257;
+    int                 ndist = InflateBits(s, 5) + 1;
+    int                 ncode = InflateBits(s, 4) + 4;
+    int                 index;
+    int                 err;
+
+    if (s->error || nlen > MAXLCODES || ndist > MAXDCODES)
+        return false;
+
+    for (index = 0; index < ncode; index++)
+        lengths[order[index]] = InflateBits(s, 3);
+
+    for (; index < 19; index++)
+        lengths[order[index]] = 0;
+
+    if (s->error || InflateConstruct(&lencode, lengths, 19))
+        return false;
+
+    // read the lengths of the literal/length and distance codes
+    index = 0;
+
+    while (index < nlen + ndist)
+    {
+        int symbol = InflateDecode(s, &lencode);
+
+        if (symbol < 0)
+            return false;
+
+        if (symbol < 16)
+            lengths[index++] = symbol;
+        else
+        {
+            int len = 0;
+
+            if (symbol == 16)
+            {
+                if (!index)
+                    return false;
+
+                len = lengths[index - 1];
+                symbol = 3 + InflateBits(s, 2);
+            }
+            else if (symbol == 17)
+                symbol = 3 + InflateBits(s, 3);
+            else
+                symbol = 11 + InflateBits(s, 7);
+
+            if (s->error || index + symbol > nlen + ndist)
+                return false;
+
+            while (symbol--)
+                lengths[index++] = len;
+        }
+    }
+
+    // there must be an end-of-block code
+    if (!lengths[256])
+        return false;
+
+    // only a code with a single symbol may be incomplete
+    if ((err = InflateConstruct(&lencode, lengths, nlen)) < 0 || (err > 0 && nlen - lencode.count[0] != 1))
+        return false;
+
+    if ((err = InflateConstruct(&distcode, lengths + nlen, ndist)) < 0
+        || (err > 0 && ndist - distcode.count[0] != 1))
+        return false;
+
+    return InflateCodes(s, &lencode, &distcode);
+}
+
+//
+// Inflate
+// Decompresses inlen bytes of deflate data into outlen bytes. Returns the
+// number of bytes decompressed, which is less than outlen if the data is
+// corrupt.
+//
+static size_t Inflate(byte *out, size_t outlen, const byte *in, size_t inlen)
+{
+    inflate_t   s;
+    int         last;
+
+    s.in = in;
+    s.inlen = inlen;
+    s.inpos = 0;
+    s.bitbuf = 0;
+    s.bitcount = 0;
+    s.out = out;
+    s.outlen = outlen;
+    s.outpos = 0;
+    s.error = false;
+
+    do
+    {
+        dboolean    result;
+
+        last = InflateBits(&s, 1);
+
+        switch (InflateBits(&s, 2))
+        {
+            case 0:
+                result = InflateStored(&s);
+                break;
+
+            case 1:
+                result = InflateFixed(&s);
+                break;
+
+            case 2:
+                result = InflateDynamic(&s);
+                break;
+
+            default:
+                result = false;
+                break;
+        }
+
+        if (!result || s.error)
+            break;
+    } while (!last);
+
+    return s.outpos;
+}
+
+//
+// ZIP DIRECTORY
+//
+
+// Finds the "end of central directory" record at the end of the file.
+static dboolean FindEndOfCentralDir(FILE *fstream, unsigned int length, byte *record)
+{
+    unsigned int    size = MIN(length, 65535 + 22);
+    byte            *buffer = malloc(size);
+    int             i;
+    dboolean        result = false;
+
+    if (!buffer)
+        return false;
+
+    if (!fseek(fstream, length - size, SEEK_SET) && fread(buffer, 1, size, fstream) == size)
+        for (i = size - 22; i >= 0; i--)
+            if (ReadLong(buffer + i) == ZIP_ENDOFCENTRALDIR)
+            {
+                memcpy(record, buffer + i, 22);
+                result = true;
+                break;
+            }
+
+    free(buffer);
+
+    return result;
+}
+
+// Works out the namespace and 8-character lump name of a file in a PK3.
+// Returns false if it isn't a lump.
+static dboolean GetLumpName(const char *path, int pathlen, char *name, int *ns)
+{
+    const char  *base = path;
+    int         i;
+
+    if (!pathlen || path[pathlen - 1] == '/')
+        return false;   // directory
+
+    for (i = 0; i < pathlen; i++)
+        if (path[i] == '/')
+            base = path + i + 1;
+
+    *ns = ns_global;
+
+    if (pathlen > 6 && !strncasecmp(path, "flats/", 6))
+        *ns = ns_flats;
+    else if (pathlen > 8 && !strncasecmp(path, "sprites/", 8))
+        *ns = ns_sprites;
+    else if (pathlen > 9 && !strncasecmp(path, "maps/", 5)
+        && !strncasecmp(path + pathlen - 4, ".wad", 4))
+        *ns = ns_maps;
+
+    memset(name, 0, 8);
+
+    for (i = 0; i < 8 && base + i < path + pathlen && base[i] != '.'; i++)
+        name[i] = toupper(base[i]);
+
+    return (i > 0);
+}
+
+static int CompareEntries(const void *a, const void *b)
+{
+    const zipentry_t    *entry1 = a;
+    const zipentry_t    *entry2 = b;
+
+    return (entry1->ns != entry2->ns ? entry1->ns - entry2->ns :
+        (int)(entry1->localheader - entry2->localheader));
+}
+
+static void AddMarker(zip_wad_file_t *zip, const char *name, unsigned int position)
+{
+    zipentry_t  *entry = &zip->entries[zip->numentries++];
+
+    memset(entry, 0, sizeof(*entry));
+    strncpy(entry->lump.name, name, 8);
+    entry->lump.position = position;
+    entry->dataoffset = -1;
+    entry->ns = ns_global;
+}
+
+static wad_file_t *W_Zip_OpenFile(char *path)
+{
+    zip_wad_file_t  *result;
+    FILE            *fstream = fopen(path, "rb");
+    unsigned int    length;
+    byte            record[22];
+    unsigned int    count;
+    unsigned int    dirsize;
+    byte            *dir;
+    byte            *p;
+    zipentry_t      *entries;
+    int             numentries = 0;
+    unsigned int    i;
+    unsigned int    position;
+    int             ns;
+
+    if (!fstream)
+        return NULL;
+
+    length = M_FileLength(fstream);
+
+    if (!FindEndOfCentralDir(fstream, length, record))
+    {
+        fclose(fstream);
+        return NULL;
+    }
+
+    count = ReadShort(record + 10);
+    dirsize = ReadLong(record + 12);
+    dir = malloc(dirsize);
+
+    if (!dir || fseek(fstream, ReadLong(record + 16), SEEK_SET) || fread(dir, 1, dirsize, fstream) != dirsize)
+    {
+        free(dir);
+        fclose(fstream);
+        return NULL;
+    }
+
+    // room for every file, plus F_START, F_END, S_START and S_END
+    entries = Z_Malloc((count + 4) * sizeof(*entries), PU_STATIC, NULL);
+
+    for (i = 0, p = dir; i < count && p + 46 <= dir + dirsize; i++)
+    {
+        unsigned int    pathlen = ReadShort(p + 28);
+        zipentry_t      *entry = &entries[numentries];
+
+        if (ReadLong(p) != ZIP_CENTRALHEADER || p + 46 + pathlen > dir + dirsize)
+            break;
+
+        if (GetLumpName((char *)p + 46, pathlen, entry->lump.name, &entry->ns))
+        {
+            entry->method = ReadShort(p + 10);
+            entry->compressedsize = ReadLong(p + 20);
+            entry->lump.size = ReadLong(p + 24);
+            entry->localheader = ReadLong(p + 42);
+            entry->dataoffset = -1;
+
+            if (entry->method == ZIP_STORED || entry->method == ZIP_DEFLATED)
+                numentries++;
+            else
+                C_Warning("%.*s in %s uses an unsupported compression method.", pathlen, p + 46,
+                    uppercase(leafname(path)));
+        }
+
+        p += 46 + pathlen + ReadShort(p + 30) + ReadShort(p + 32);
+    }
+
+    free(dir);
+
+    // keep lumps in the order they are in the file, but group flats and
+    // sprites together so they can go between markers
+    qsort(entries, numentries, sizeof(*entries), CompareEntries);
+
+    result = Z_Malloc(sizeof(zip_wad_file_t), PU_STATIC, NULL);
+    result->wad.file_class = &zip_wad_file;
+    result->wad.mapped = NULL;
+    result->wad.type = PK3;
+    M_StringCopy(result->wad.path, path, sizeof(result->wad.path));
+    result->fstream = fstream;
+    result->entries = Z_Malloc((count + 4) * sizeof(*entries), PU_STATIC, NULL);
+    result->numentries = 0;
+    result->lastentry = -1;
+    result->lastdata = NULL;
+
+    // lay the lumps out one after another, adding markers around flats and sprites
+    position = 0;
+    ns = ns_global;
+
+    for (i = 0; i < (unsigned int)numentries; i++)
+    {
+        zipentry_t  *entry = &entries[i];
+
+        if (entry->ns != ns)
+        {
+            if (ns == ns_flats)
+                AddMarker(result, "F_END", position);
+            else if (ns == ns_sprites)
+                AddMarker(result, "S_END", position);
+
+            ns = entry->ns;
+
+            if (ns == ns_flats)
+                AddMarker(result, "F_START", position);
+            else if (ns == ns_sprites)
+                AddMarker(result, "S_START", position);
+        }
+
+        entry->lump.position = position;
+        position += entry->lump.size;
+        result->entries[result->numentries++] = *entry;
+    }
+
+    if (ns == ns_flats)
+        AddMarker(result, "F_END", position);
+    else if (ns == ns_sprites)
+        AddMarker(result, "S_END", position);
+
+    Z_Free(entries);
+
+    result->wad.length = position;
+
+    return &result->wad;
+}
+
+static void W_Zip_CloseFile(wad_file_t *wad)
+{
+    zip_wad_file_t  *zip = (zip_wad_file_t *)wad;
+
+    fclose(zip->fstream);
+    free(zip->lastdata);
+    Z_Free(zip->entries);
+    Z_Free(zip);
+}
+
+// Decompresses a lump into buffer, which must be at least its size.
+static size_t W_Zip_ReadEntry(zip_wad_file_t *zip, zipentry_t *entry, byte *buffer)
+{
+    byte    *data;
+    size_t  result = 0;
+
+    if (entry->dataoffset < 0)
+    {
+        byte    header[30];
+
+        if (fseek(zip->fstream, entry->localheader, SEEK_SET) || fread(header, 1, 30, zip->fstream) != 30
+            || ReadLong(header) != ZIP_LOCALHEADER)
+            return 0;
+
+        entry->dataoffset = entry->localheader + 30 + ReadShort(header + 26) + ReadShort(header + 28);
+    }
+
+    if (fseek(zip->fstream, entry->dataoffset, SEEK_SET))
+        return 0;
+
+    if (entry->method == ZIP_STORED)
+        return fread(buffer, 1, entry->lump.size, zip->fstream);
+
+    if (!(data = malloc(entry->compressedsize)))
+        return 0;
+
+    if (fread(data, 1, entry->compressedsize, zip->fstream) == entry->compressedsize)
+        result = Inflate(buffer, entry->lump.size, data, entry->compressedsize);
+
+    free(data);
+
+    return result;
+}
+
+// Read data from the specified position in the decompressed file into the
+// provided buffer. Returns the number of bytes read.
+static size_t W_Zip_Read(wad_file_t *wad, unsigned int offset, void *buffer, size_t buffer_len)
+{
+    zip_wad_file_t  *zip = (zip_wad_file_t *)wad;
+    byte            *dest = buffer;
+    size_t          bytes_read = 0;
+    int             low = 0;
+    int             high = zip->numentries - 1;
+    int             i;
+
+    // find the first lump that ends after offset
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+
+        if (zip->entries[mid].lump.position + zip->entries[mid].lump.size <= offset)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    for (i = low; i < zip->numentries && bytes_read < buffer_len; i++)
+    {
+        zipentry_t      *entry = &zip->entries[i];
+        unsigned int    start = offset + bytes_read - entry->lump.position;
+        size_t          len;
+
+        if (!entry->lump.size)
+            continue;
+
+        len = entry->lump.size - start;
+
+        if (len > buffer_len - bytes_read)
+            len = buffer_len - bytes_read;
+
+        if (!start && len == entry->lump.size && zip->lastentry != i)
+        {
+            // reading a whole lump, so decompress it straight into the buffer
+            if (W_Zip_ReadEntry(zip, entry, dest + bytes_read) != len)
+                break;
+        }
+        else
+        {
+            // reading part of a lump, so keep it around for the next read
+            if (zip->lastentry != i)
+            {
+                free(zip->lastdata);
+                zip->lastentry = -1;
+
+                if (!(zip->lastdata = malloc(entry->lump.size))
+                    || W_Zip_ReadEntry(zip, entry, zip->lastdata) != entry->lump.size)
+                    break;
+
+                zip->lastentry = i;
+            }
+
+            memcpy(dest + bytes_read, zip->lastdata + start, len);
+        }
+
+        bytes_read += len;
+    }
+
+    return bytes_read;
+}
+
+// Reads the directory of a WAD in the maps folder of a PK3. Returns NULL if
+// it isn't a valid WAD.
+static byte *ReadMapWADDirectory(zip_wad_file_t *zip, zipentry_t *entry, int *count)
+{
+    byte            header[12];
+    byte            *dir;
+    unsigned int    size = entry->lump.size;
+    unsigned int    numlumps;
+    unsigned int    infotableofs;
+    unsigned int    i;
+
+    if (size < 12 || W_Zip_Read(&zip->wad, entry->lump.position, header, 12) != 12
+        || (memcmp(header, "PWAD", 4) && memcmp(header, "IWAD", 4)))
+        return NULL;
+
+    numlumps = ReadLong(header + 4);
+    infotableofs = ReadLong(header + 8);
+
+    if (infotableofs > size || numlumps > (size - infotableofs) / 16
+        || !(dir = malloc(MAX(1, numlumps * 16))))
+        return NULL;
+
+    if (W_Zip_Read(&zip->wad, entry->lump.position + infotableofs, dir, numlumps * 16)
+        != numlumps * 16)
+    {
+        free(dir);
+        return NULL;
+    }
+
+    // every lump must be inside the WAD
+    for (i = 0; i < numlumps; i++)
+    {
+        unsigned int    filepos = ReadLong(dir + i * 16);
+
+        if (filepos > size || ReadLong(dir + i * 16 + 4) > size - filepos)
+        {
+            free(dir);
+            return NULL;
+        }
+    }
+
+    *count = numlumps;
+    return dir;
+}
+
+//
+// W_GetZipLumps
+// Returns the number of lumps in a PK3 file, and a list of them in
+// lumps that should be freed with Z_Free(). Each WAD in the maps folder is
+// replaced by the lumps in it.
+//
+int W_GetZipLumps(wad_file_t *wad, ziplump_t **lumps)
+{
+    zip_wad_file_t  *zip = (zip_wad_file_t *)wad;
+    ziplump_t       *list = NULL;
+    int             numlumps = 0;
+    int             maxlumps = 0;
+    int             i;
+
+    for (i = 0; i < zip->numentries; i++)
+    {
+        zipentry_t  *entry = &zip->entries[i];
+        byte        *dir;
+        int         count;
+        int         j;
+
+        if (entry->ns != ns_maps)
+        {
+            if (numlumps == maxlumps)
+                list = Z_Realloc(list, (maxlumps = maxlumps * 2 + 64) * sizeof(*list));
+
+            list[numlumps++] = entry->lump;
+            continue;
+        }
+
+        // a WAD in the maps folder, so add the lumps in it instead, or
+        // nothing if it isn't a valid WAD
+        if (!(dir = ReadMapWADDirectory(zip, entry, &count)))
+            continue;
+
+        if (numlumps + count > maxlumps)
+            list = Z_Realloc(list, (maxlumps = (numlumps + count) * 2) * sizeof(*list));
+
+        for (j = 0; j < count; j++)
+        {
+            byte        *p = dir + j * 16;
+            ziplump_t   *lump = &list[numlumps++];
+
+            lump->position = entry->lump.position + ReadLong(p);
+            lump->size = ReadLong(p + 4);
+            memcpy(lump->name, p + 8, 8);
+        }
+
+        free(dir);
+    }
+
+    *lumps = Z_Malloc(MAX(1, numlumps) * sizeof(**lumps), PU_STATIC, NULL);
+    memcpy(*lumps, list, numlumps * sizeof(**lumps));
+    free(list);
+
+    return numlumps;
+}
+
+wad_file_class_t zip_wad_file =
+{
+    W_Zip_OpenFile,
+    W_Zip_CloseFile,
+    W_Zip_Read,
+    NULL
+};
@@ -66,18 +66,30 @@ typedef struct
     lumpinfo_t          *angle_lumps[8];
 } sprite_frame_t;
 
+// a PWAD added by W_MergeFile() that is waiting to be merged
+typedef struct
+{
+    lumpindex_t         start;
+    int                 numlumps;
+    searchlist_t        sprites;
+    searchlist_t        flats;
+} mergefile_t;
+
 static searchlist_t     iwad;
 static searchlist_t     iwad_sprites;
-static searchlist_t     pwad;
-
 static searchlist_t     iwad_flats;
-static searchlist_t     pwad_sprites;
-static searchlist_t     pwad_flats;
+
+static mergefile_t      *mergefiles;
+static int              nummergefiles;
+static int              mergefiles_alloced;
 
 // lumps with these sprites must be replaced in the IWAD
 static sprite_frame_t   *sprite_frames;
 static int              num_sprite_frames;
-static int              sprite_frames_alloced;
+static namehash_t       sprite_frames_hash;
+
+// the last PWAD to provide each flat, numbered from 1
+static namehash_t       flats_hash;
 
 // Search in a list to find a lump with a particular name
 // Linear search (slow!)
@@ -126,6 +138,8 @@ static dboolean SetupList(searchlist_t *list, searchlist_t *src_list,
 // Sets up the sprite/flat search lists
 static void SetupLists(void)
 {
+    int i;
+
     // IWAD
     if (!SetupList(&iwad_flats, &iwad, "F_START", "F_END", NULL, NULL))
         I_Error("Flats section not found in IWAD");
@@ -133,21 +147,51 @@ static void SetupLists(void)
     if (!SetupList(&iwad_sprites, &iwad, "S_START", "S_END", NULL, NULL))
         I_Error("Sprites section not found in IWAD");
 
-    // PWAD
-    SetupList(&pwad_flats, &pwad, "F_START", "F_END", "FF_START", "FF_END");
-    SetupList(&pwad_sprites, &pwad, "S_START", "S_END", "SS_START", "SS_END");
+    // PWADs
+    for (i = 0; i < nummergefiles; ++i)
+    {
+        mergefile_t     *file = &mergefiles[i];
+        searchlist_t    pwad;
+
+        pwad.lumps = lumpinfo + file->start;
+        pwad.numlumps = file->numlumps;
+
+        SetupList(&file->flats, &pwad, "F_START", "F_END", "FF_START", "FF_END");
+        SetupList(&file->sprites, &pwad, "S_START", "S_END", "SS_START", "SS_END");
+    }
 }
 
-// Initialize the replace list
-static void InitSpriteList(void)
+// Record which PWAD provides the final copy of each flat. A flat is kept
+// only from the last file to provide it, which gives the same result as
+// merging each PWAD in turn.
+static void GenerateFlatList(void)
 {
-    if (!sprite_frames)
-    {
-        sprite_frames_alloced = 128;
-        sprite_frames = Z_Malloc(sizeof(*sprite_frames) * sprite_frames_alloced, PU_STATIC, NULL);
-    }
+    int count = 0;
+    int i, n;
+
+    for (i = 0; i < nummergefiles; ++i)
+        count += mergefiles[i].flats.numlumps;
+
+    W_InitNameHash(&flats_hash, count);
+
+    for (i = 0; i < nummergefiles; ++i)
+        for (n = 0; n < mergefiles[i].flats.numlumps; ++n)
+            *W_NameHashSlot(&flats_hash, W_LumpNameKey(mergefiles[i].flats.lumps[n]->name)) = i + 1;
+}
+
+static dboolean FlatLumpNeeded(lumpinfo_t *lump, int file)
+{
+    return (W_NameHashFind(&flats_hash, W_LumpNameKey(lump->name)) == file);
+}
 
+// Initialize the replace list
+static void InitSpriteList(int count)
+{
+    // each sprite lump can name up to two frames
+    sprite_frames = Z_Malloc(sizeof(*sprite_frames) * MAX(1, count * 2), PU_STATIC, NULL);
     num_sprite_frames = 0;
+
+    W_InitNameHash(&sprite_frames_hash, count * 2);
 }
 
 static dboolean ValidSpriteLumpName(char *name)
@@ -170,30 +214,19 @@ static dboolean ValidSpriteLumpName(char *name)
 static sprite_frame_t *FindSpriteFrame(char *name, char frame)
 {
     sprite_frame_t      *result;
+    int                 *slot;
     int                 i;
 
-    // Search the list and try to find the frame
-    for (i = 0; i < num_sprite_frames; ++i)
-    {
-        sprite_frame_t  *cur = &sprite_frames[i];
+    // The sprite name is compared without regard to case, but the frame
+    // letter is not
+    slot = W_NameHashSlot(&sprite_frames_hash,
+        ((W_LumpNameKey(name) & 0xFFFFFFFF) | ((uint64_t)(unsigned char)frame << 32)));
 
-        if (!strncasecmp(cur->sprname, name, 4) && cur->frame == frame)
-            return cur;
-    }
+    if (*slot >= 0)
+        return &sprite_frames[*slot];
 
     // Not found in list; Need to add to the list
-
-    // Grow list?
-    if (num_sprite_frames >= sprite_frames_alloced)
-    {
-        sprite_frame_t  *newframes;
-
-        newframes = Z_Malloc(sprite_frames_alloced * 2 * sizeof(*sprite_frames), PU_STATIC, NULL);
-        memcpy(newframes, sprite_frames, sprite_frames_alloced * sizeof(*sprite_frames));
-        Z_Free(sprite_frames);
-        sprite_frames_alloced *= 2;
-        sprite_frames = newframes;
-    }
+    *slot = num_sprite_frames;
 
     // Add to end of list
     result = &sprite_frames[num_sprite_frames];
@@ -304,45 +337,62 @@ static void AddSpriteLump(lumpinfo_t *lump)
 // Generate the list. Run at the start, before merging
 static void GenerateSpriteList(void)
 {
-    int i;
+    int count = iwad_sprites.numlumps;
+    int i, n;
 
-    InitSpriteList();
+    for (i = 0; i < nummergefiles; ++i)
+        count += mergefiles[i].sprites.numlumps;
+
+    InitSpriteList(count);
 
     // Add all sprites from the IWAD
     for (i = 0; i < iwad_sprites.numlumps; ++i)
         AddSpriteLump(iwad_sprites.lumps[i]);
 
-    // Add all sprites from the PWAD
-    // (replaces IWAD sprites)
-    for (i = 0; i < pwad_sprites.numlumps; ++i)
-        AddSpriteLump(pwad_sprites.lumps[i]);
+    // Add all sprites from the PWADs, in the order they were added
+    // (replaces IWAD sprites and those of earlier PWADs)
+    for (i = 0; i < nummergefiles; ++i)
+        for (n = 0; n < mergefiles[i].sprites.numlumps; ++n)
+            AddSpriteLump(mergefiles[i].sprites.lumps[n]);
+}
+
+static void FreeLists(void)
+{
+    W_FreeNameHash(&flats_hash);
+    W_FreeNameHash(&sprite_frames_hash);
+    Z_Free(sprite_frames);
+    sprite_frames = NULL;
+    num_sprite_frames = 0;
 }
 
 // Perform the merge.
 //
 // The merge code creates a new lumpinfo list, adding entries from the
-// IWAD first followed by the PWAD.
+// IWAD first followed by each PWAD in turn.
 //
 // For the IWAD:
-//  * Flats are added. If a flat with the same name is in the PWAD,
+//  * Flats are added. If a flat with the same name is in a PWAD,
 //    it is ignored (deleted). At the end of the section, all flats in the
-//    PWAD are inserted. This is consistent with the behavior of
-//    deutex/deusf.
+//    PWADs are inserted, except those also in a later PWAD. This is
+//    consistent with the behavior of deutex/deusf.
 //  * Sprites are added. The "replace list" is generated before the merge
-//    from the list of sprites in the PWAD. Any sprites in the IWAD found
+//    from the list of sprites in the PWADs. Any sprites in the IWAD found
 //    to match the replace list are removed. At the end of the section,
-//    the sprites from the PWAD are inserted.
+//    the sprites from the PWADs are inserted.
 //
-// For the PWAD:
+// For the PWADs:
 //  * All Sprites and Flats are ignored, with the assumption they have
 //    already been merged into the IWAD's sections.
+//
+// Any lumps added between the PWADs with W_AddFile() are copied as they
+// are.
 static void DoMerge(void)
 {
     section_t   current_section;
     lumpinfo_t  **newlumps;
     int         num_newlumps;
-    int         lumpindex;
-    int         i, n;
+    int         i, n, file;
+    lumpindex_t lumpindex;
 
     // Can't ever have more lumps than we already have
     newlumps = calloc(numlumps, sizeof(lumpinfo_t *));
@@ -371,10 +421,16 @@ static void DoMerge(void)
                 // Have we reached the end of the section?
                 if (!strncasecmp(lump->name, "F_END", 8))
                 {
-                    // Add all new flats from the PWAD to the end
+                    // Add all new flats from the PWADs to the end
                     // of the section
-                    for (n = 0; n < pwad_flats.numlumps; ++n)
-                        newlumps[num_newlumps++] = pwad_flats.lumps[n];
+                    for (file = 0; file < nummergefiles; ++file)
+                    {
+                        searchlist_t    *pwad_flats = &mergefiles[file].flats;
+
+                        for (n = 0; n < pwad_flats->numlumps; ++n)
+                            if (FlatLumpNeeded(pwad_flats->lumps[n], file + 1))
+                                newlumps[num_newlumps++] = pwad_flats->lumps[n];
+                    }
 
                     newlumps[num_newlumps++] = lump;
 
@@ -383,13 +439,11 @@ static void DoMerge(void)
                 }
                 else
                 {
-                    // If there is a flat in the PWAD with the same name,
+                    // If there is a flat in a PWAD with the same name,
                     // do not add it now. All PWAD flats are added to the
                     // end of the section. Otherwise, if it is only in the
                     // IWAD, add it now
-                    lumpindex = FindInList(&pwad_flats, lump->name);
-
-                    if (lumpindex < 0)
+                    if (FlatLumpNeeded(lump, -1))
                         newlumps[num_newlumps++] = lump;
                 }
 
@@ -400,10 +454,13 @@ static void DoMerge(void)
                 if (!strncasecmp(lump->name, "S_END", 8))
                 {
                     // add all the PWAD sprites
-                    for (n = 0; n < pwad_sprites.numlumps; ++n)
+                    for (file = 0; file < nummergefiles; ++file)
                     {
-                        if (SpriteLumpNeeded(pwad_sprites.lumps[n]))
-                            newlumps[num_newlumps++] = pwad_sprites.lumps[n];
+                        searchlist_t    *pwad_sprites = &mergefiles[file].sprites;
+
+                        for (n = 0; n < pwad_sprites->numlumps; ++n)
+                            if (SpriteLumpNeeded(pwad_sprites->lumps[n]))
+                                newlumps[num_newlumps++] = pwad_sprites->lumps[n];
                     }
 
                     // copy the ending
@@ -414,7 +471,7 @@ static void DoMerge(void)
                 }
                 else
                 {
-                    // Is this lump holding a sprite to be replaced in the
+                    // Is this lump holding a sprite to be replaced in a
                     // PWAD? If so, wait until the end to add it.
                     if (SpriteLumpNeeded(lump))
                         newlumps[num_newlumps++] = lump;
@@ -425,57 +482,75 @@ static void DoMerge(void)
     }
 
     // Add PWAD lumps
-    current_section = SECTION_NORMAL;
+    lumpindex = iwad.numlumps;
 
-    for (i = 0; i < pwad.numlumps; ++i)
+    for (file = 0; file < nummergefiles; ++file)
     {
-        lumpinfo_t      *lump = pwad.lumps[i];
+        mergefile_t     *pwad = &mergefiles[file];
 
-        switch (current_section)
+        // copy any lumps added since the previous PWAD
+        while (lumpindex < pwad->start)
+            newlumps[num_newlumps++] = lumpinfo[lumpindex++];
+
+        current_section = SECTION_NORMAL;
+
+        for (i = 0; i < pwad->numlumps; ++i)
         {
-            case SECTION_NORMAL:
-                if (!strncasecmp(lump->name, "F_START", 8)
-                    || !strncasecmp(lump->name, "FF_START", 8))
-                    current_section = SECTION_FLATS;
-                else if (!strncasecmp(lump->name, "S_START", 8)
-                    || !strncasecmp(lump->name, "SS_START", 8))
-                    current_section = SECTION_SPRITES;
-                else
-                {
-                    // Don't include the headers of sections
-                    newlumps[num_newlumps++] = lump;
-                }
-                break;
+            lumpinfo_t  *lump = lumpinfo[pwad->start + i];
+
+            switch (current_section)
+            {
+                case SECTION_NORMAL:
+                    if (!strncasecmp(lump->name, "F_START", 8)
+                        || !strncasecmp(lump->name, "FF_START", 8))
+                        current_section = SECTION_FLATS;
+                    else if (!strncasecmp(lump->name, "S_START", 8)
+                        || !strncasecmp(lump->name, "SS_START", 8))
+                        current_section = SECTION_SPRITES;
+                    else
+                    {
+                        // Don't include the headers of sections
+                        newlumps[num_newlumps++] = lump;
+                    }
+                    break;
 
-            case SECTION_FLATS:
-                // PWAD flats are ignored (already merged)
-                if (!strncasecmp(lump->name, "FF_END", 8)
-                    || !strncasecmp(lump->name, "F_END", 8))
-                {
-                    // end of section
-                    current_section = SECTION_NORMAL;
-                }
-                break;
+                case SECTION_FLATS:
+                    // PWAD flats are ignored (already merged)
+                    if (!strncasecmp(lump->name, "FF_END", 8)
+                        || !strncasecmp(lump->name, "F_END", 8))
+                    {
+                        // end of section
+                        current_section = SECTION_NORMAL;
+                    }
+                    break;
 
-            case SECTION_SPRITES:
-                // PWAD sprites are ignored (already merged)
-                if (!strncasecmp(lump->name, "SS_END", 8)
-                    || !strncasecmp(lump->name, "S_END", 8))
-                {
-                    // end of section
-                    current_section = SECTION_NORMAL;
-                }
-                break;
+                case SECTION_SPRITES:
+                    // PWAD sprites are ignored (already merged)
+                    if (!strncasecmp(lump->name, "SS_END", 8)
+                        || !strncasecmp(lump->name, "S_END", 8))
+                    {
+                        // end of section
+                        current_section = SECTION_NORMAL;
+                    }
+                    break;
+            }
         }
+
+        lumpindex = pwad->start + pwad->numlumps;
     }
 
+    while (lumpindex < numlumps)
+        newlumps[num_newlumps++] = lumpinfo[lumpindex++];
+
     // Switch to the new lumpinfo, and free the old one
     free(lumpinfo);
     lumpinfo = newlumps;
     numlumps = num_newlumps;
 }
 
-// Merge in a file by name
+// Merge in a file by name. The file's lumps are added to the end of the
+// directory now, and its sprites and flats are merged into the IWAD's
+// by W_MergeFiles().
 dboolean W_MergeFile(char *filename, dboolean automatic)
 {
     int old_numlumps = numlumps;
@@ -484,21 +559,41 @@ dboolean W_MergeFile(char *filename, dboolean automatic)
     if (!W_AddFile(filename, automatic))
         return false;
 
-    // IWAD is at the start, PWAD was appended to the end
-    iwad.lumps = lumpinfo;
-    iwad.numlumps = old_numlumps;
+    if (nummergefiles == mergefiles_alloced)
+    {
+        mergefiles_alloced = (mergefiles_alloced ? mergefiles_alloced * 2 : 8);
+        mergefiles = Z_Realloc(mergefiles, mergefiles_alloced * sizeof(*mergefiles));
+    }
+
+    mergefiles[nummergefiles].start = old_numlumps;
+    mergefiles[nummergefiles].numlumps = numlumps - old_numlumps;
+    ++nummergefiles;
+
+    return true;
+}
 
-    pwad.lumps = lumpinfo + old_numlumps;
-    pwad.numlumps = numlumps - old_numlumps;
+// Merge the sprites and flats of every PWAD added with W_MergeFile() into
+// the IWAD's sections at once, so the lump directory is only rebuilt once
+// however many PWADs are loaded.
+void W_MergeFiles(void)
+{
+    if (!nummergefiles)
+        return;
+
+    // IWAD is at the start, PWADs were appended to the end
+    iwad.lumps = lumpinfo;
+    iwad.numlumps = mergefiles[0].start;
 
     // Setup sprite/flat lists
     SetupLists();
 
-    // Generate list of sprites to be replaced by the PWAD
+    // Generate list of flats and sprites to be replaced by the PWADs
+    GenerateFlatList();
     GenerateSpriteList();
 
     // Perform the merge
     DoMerge();
 
-    return true;
+    FreeLists();
+    nummergefiles = 0;
 }
@@ -42,4 +42,7 @@
 // Add a new WAD and merge it into the main directory
 dboolean W_MergeFile(char *filename, dboolean automatic);
 
+// Merge the sprites and flats of all the WADs added with W_MergeFile()
+void W_MergeFiles(void);
+
 #endif
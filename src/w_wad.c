@@ -80,7 +80,7 @@ lumpinfo_t      **lumpinfo;
 int             numlumps = 0;
 
 // Hash table for fast lookups
-static lumpindex_t      *lumphash;
+static namehash_t       lumphash;
 
 void ExtractFileBase(char *path, char *dest)
 {
@@ -100,18 +100,88 @@ void ExtractFileBase(char *path, char *dest)
         dest[length++] = (char)toupper((int)*src++);
 }
 
-// Hash function used for lump names.
-unsigned int W_LumpNameHash(const char *s)
+//
+// W_LumpNameKey
+// Packs up to 8 characters of a name into a 64-bit key, in uppercase and
+// padded with zeros, so names can be compared case-insensitively as
+// integers.
+//
+uint64_t W_LumpNameKey(const char *name)
 {
-    // This is the djb2 string hash function, modded to work on strings
-    // that have a maximum length of 8.
-    unsigned int        result = 5381;
-    unsigned int        i;
+    uint64_t    key = 0;
+    int         i;
 
-    for (i = 0; i < 8 && s[i] != '\0'; ++i)
-        result = ((result << 5) ^ result) ^ toupper(s[i]);
+    for (i = 0; i < 8 && name[i] != '\0'; ++i)
+        key |= (uint64_t)(unsigned char)toupper(name[i]) << (i * 8);
 
-    return result;
+    return key;
+}
+
+//
+// W_InitNameHash
+// Creates an empty name hash with room for count names.
+//
+void W_InitNameHash(namehash_t *hash, int count)
+{
+    unsigned int    size = 16;
+    unsigned int    i;
+
+    // keep the table at most half full
+    while (size < (unsigned int)count * 2)
+        size <<= 1;
+
+    hash->entries = Z_Malloc(size * sizeof(*hash->entries), PU_STATIC, NULL);
+    hash->mask = size - 1;
+
+    for (i = 0; i < size; ++i)
+        hash->entries[i].index = -1;
+}
+
+void W_FreeNameHash(namehash_t *hash)
+{
+    Z_Free(hash->entries);
+    hash->entries = NULL;
+    hash->mask = 0;
+}
+
+static unsigned int W_NameHashStart(const namehash_t *hash, uint64_t key)
+{
+    return ((unsigned int)((key * 0x9E3779B97F4A7C15ull) >> 32) & hash->mask);
+}
+
+//
+// W_NameHashSlot
+// Returns the index stored for key, adding key with an index of -1 if it
+// isn't there yet.
+//
+int *W_NameHashSlot(namehash_t *hash, uint64_t key)
+{
+    unsigned int    i = W_NameHashStart(hash, key);
+
+    while (hash->entries[i].index != -1 && hash->entries[i].key != key)
+        i = (i + 1) & hash->mask;
+
+    hash->entries[i].key = key;
+    return &hash->entries[i].index;
+}
+
+//
+// W_NameHashFind
+// Returns the index stored for key, or -1 if it isn't there.
+//
+int W_NameHashFind(const namehash_t *hash, uint64_t key)
+{
+    unsigned int    i = W_NameHashStart(hash, key);
+
+    while (hash->entries[i].index != -1)
+    {
+        if (hash->entries[i].key == key)
+            return hash->entries[i].index;
+
+        i = (i + 1) & hash->mask;
+    }
+
+    return -1;
 }
 
 //
@@ -144,9 +214,27 @@ wad_file_t *W_AddFile(char *filename, dboolean automatic)
 
     M_StringCopy(wad_file->path, filename, sizeof(wad_file->path));
 
-    wad_file->freedoom = IsFreedoom(filename);
+    if (wad_file->type == PK3)
+    {
+        // PK3 file
+        ziplump_t   *ziplumps;
+
+        wad_file->freedoom = false;
+        memcpy(header.identification, "PK3 ", 4);
+        numfilelumps = W_GetZipLumps(wad_file, &ziplumps);
+        fileinfo = Z_Malloc(MAX(1, numfilelumps) * sizeof(filelump_t), PU_STATIC, 0);
 
-    if (!M_StringCompare(filename + strlen(filename) - 3, "wad"))
+        // construct a "fake WAD directory" as for a single lump file
+        for (i = 0; i < numfilelumps; i++)
+        {
+            fileinfo[i].filepos = LONG(ziplumps[i].position);
+            fileinfo[i].size = LONG(ziplumps[i].size);
+            memcpy(fileinfo[i].name, ziplumps[i].name, 8);
+        }
+
+        Z_Free(ziplumps);
+    }
+    else if (!M_StringCompare(filename + strlen(filename) - 3, "wad"))
     {
         // single lump file
 
@@ -162,6 +250,7 @@ wad_file_t *W_AddFile(char *filename, dboolean automatic)
         // extension).
         ExtractFileBase(filename, fileinfo->name);
         numfilelumps = 1;
+        wad_file->freedoom = IsFreedoom(filename);
     }
     else
     {
@@ -175,6 +264,8 @@ wad_file_t *W_AddFile(char *filename, dboolean automatic)
             && strncmp(header.identification, "PWAD", 4))
             I_Error("Wad file %s doesn't have IWAD or PWAD id\n", filename);
 
+        wad_file->freedoom = IsFreedoom(filename);
+
         wad_file->type = (!strncmp(header.identification, "IWAD", 4) ? IWAD : PWAD);
 
         header.numlumps = LONG(header.numlumps);
@@ -215,15 +306,12 @@ wad_file_t *W_AddFile(char *filename, dboolean automatic)
 
     Z_Free(fileinfo);
 
-    if (lumphash)
-    {
-        Z_Free(lumphash);
-        lumphash = NULL;
-    }
+    if (lumphash.entries)
+        W_FreeNameHash(&lumphash);
 
-    C_Output("%s %s lump%s from %.4s file %s.", (automatic ? "Automatically added" : "Added"),
+    C_Output("%s %s lump%s from %.*s file %s.", (automatic ? "Automatically added" : "Added"),
         commify(numlumps - startlump), (numlumps - startlump == 1 ? "" : "s"),
-        header.identification, uppercase(filename));
+        (wad_file->type == PK3 ? 3 : 4), header.identification, uppercase(filename));
 
     return wad_file;
 }
@@ -263,15 +351,52 @@ dboolean IsFreedoom(const char *iwadname)
     return result;
 }
 
+//
+// GetPK3Lumps
+// Returns the number of lumps in a PK3 file, and a list of them in lumps that
+// should be freed with Z_Free(), or -1 if it isn't a PK3 file.
+//
+static int GetPK3Lumps(const char *filename, ziplump_t **lumps)
+{
+    wad_file_t  *wad_file;
+    int         result;
+
+    if (strlen(filename) <= 4 || !M_StringCompare(filename + strlen(filename) - 4, ".pk3")
+        || !(wad_file = W_OpenFile((char *)filename)))
+        return -1;
+
+    result = W_GetZipLumps(wad_file, lumps);
+    W_CloseFile(wad_file);
+
+    return result;
+}
+
 dboolean HasDehackedLump(const char *pwadname)
 {
-    FILE        *fp = fopen(pwadname, "rb");
+    FILE        *fp;
     filelump_t  lump;
     wadinfo_t   header;
     const char  *n = lump.name;
     int         result = false;
+    ziplump_t   *ziplumps;
+    int         numziplumps = GetPK3Lumps(pwadname, &ziplumps);
 
-    if (!fp)
+    if (numziplumps >= 0)
+    {
+        int     i;
+
+        for (i = 0; i < numziplumps; ++i)
+            if (!strncmp(ziplumps[i].name, "DEHACKED", 8))
+            {
+                result = true;
+                break;
+            }
+
+        Z_Free(ziplumps);
+        return result;
+    }
+
+    if (!(fp = fopen(pwadname, "rb")))
         return false;
 
     // read IWAD header
@@ -300,13 +425,33 @@ dboolean HasDehackedLump(const char *pwadname)
 
 int IWADRequiredByPWAD(const char *pwadname)
 {
-    FILE        *fp = fopen(pwadname, "rb");
+    FILE        *fp;
     filelump_t  lump;
     wadinfo_t   header;
     const char  *n = lump.name;
     int         result = indetermined;
+    ziplump_t   *ziplumps;
+    int         numziplumps = GetPK3Lumps(pwadname, &ziplumps);
 
-    if (!fp)
+    if (numziplumps >= 0)
+    {
+        int     i;
+
+        for (i = 0; i < numziplumps; ++i)
+        {
+            n = ziplumps[i].name;
+
+            if (*n == 'E' && n[2] == 'M' && !n[4])
+                result = doom;
+            else if (*n == 'M' && n[1] == 'A' && n[2] == 'P' && !n[5])
+                result = doom2;
+        }
+
+        Z_Free(ziplumps);
+        return result;
+    }
+
+    if (!(fp = fopen(pwadname, "rb")))
         I_Error("Can't open PWAD: %s\n", pwadname);
 
     if (fread(&header, 1, sizeof(header), fp) != sizeof(header) ||
@@ -330,7 +475,7 @@ int IWADRequiredByPWAD(const char *pwadname)
 
 //
 // W_WadType
-// Returns IWAD, PWAD or 0.
+// Returns IWAD, PWAD, PK3 or 0.
 //
 int W_WadType(char *filename)
 {
@@ -340,6 +485,12 @@ int W_WadType(char *filename)
     if (!wad_file)
         return 0;
 
+    if (wad_file->type == PK3)
+    {
+        W_CloseFile(wad_file);
+        return PK3;
+    }
+
     W_Read(wad_file, 0, &header, sizeof(header));
 
     W_CloseFile(wad_file);
@@ -361,17 +512,9 @@ lumpindex_t W_CheckNumForName(char *name)
     lumpindex_t i;
 
     // Do we have a hash table yet?
-    if (lumphash)
-    {
-        int     hash;
-
+    if (lumphash.entries)
         // We do! Excellent.
-        hash = W_LumpNameHash(name) % numlumps;
-
-        for (i = lumphash[hash]; i != -1; i = lumpinfo[i]->next)
-            if (!strncasecmp(lumpinfo[i]->name, name, 8))
-                return i;
-    }
+        return W_NameHashFind(&lumphash, W_LumpNameKey(name));
     else
     {
         // We don't have a hash table generate yet. Linear search :-(
@@ -397,6 +540,14 @@ int W_CheckMultipleLumps(char *name)
     if (FREEDOOM || hacx)
         return 3;
 
+    if (lumphash.entries)
+    {
+        for (i = W_NameHashFind(&lumphash, W_LumpNameKey(name)); i != -1; i = lumpinfo[i]->next)
+            ++count;
+
+        return count;
+    }
+
     for (i = numlumps - 1; i >= 0; --i)
         if (!strncasecmp(lumpinfo[i]->name, name, 8))
             ++count;
@@ -413,6 +564,18 @@ lumpindex_t W_RangeCheckNumForName(lumpindex_t min, lumpindex_t max, char *name)
 {
     lumpindex_t i;
 
+    if (lumphash.entries)
+    {
+        lumpindex_t result = -1;
+
+        // lumps with the same name are chained from last to first
+        for (i = W_NameHashFind(&lumphash, W_LumpNameKey(name)); i >= min; i = lumpinfo[i]->next)
+            if (i <= max)
+                result = i;
+
+        return result;
+    }
+
     for (i = min; i <= max; i++)
         if (!strncasecmp(lumpinfo[i]->name, name, 8))
             return i;
@@ -439,6 +602,14 @@ lumpindex_t W_GetNumForName2(char *name)
 {
     lumpindex_t i;
 
+    if (lumphash.entries && (i = W_NameHashFind(&lumphash, W_LumpNameKey(name))) != -1)
+    {
+        while (lumpinfo[i]->next != -1)
+            i = lumpinfo[i]->next;
+
+        return i;
+    }
+
     for (i = 0; i < numlumps; i++)
         if (!strncasecmp(lumpinfo[i]->name, name, 8))
             break;
@@ -545,6 +716,27 @@ void *W_CacheLumpNum(lumpindex_t lumpnum, int tag)
     return result;
 }
 
+//
+// W_PrecacheLumpNum
+// Like W_CacheLumpNum(), but if the lump is in a memory-mapped file, asks
+// the OS to start reading it in rather than waiting for it to be touched.
+// Lumps that are already cached are left as they are.
+//
+void W_PrecacheLumpNum(lumpindex_t lumpnum, int tag)
+{
+    lumpinfo_t  *lump;
+
+    if (lumpnum >= numlumps)
+        I_Error("W_PrecacheLumpNum: %i >= numlumps", lumpnum);
+
+    lump = lumpinfo[lumpnum];
+
+    if (lump->wad_file->mapped)
+        W_Prefetch(lump->wad_file, lump->position, lump->size);
+    else if (!lump->cache)
+        W_CacheLumpNum(lumpnum, tag);
+}
+
 //
 // W_CacheLumpName
 //
@@ -584,28 +776,24 @@ void W_ReleaseLumpName(char *name)
 void W_GenerateHashTable(void)
 {
     // Free the old hash table, if there is one
-    if (lumphash)
-        Z_Free(lumphash);
+    if (lumphash.entries)
+        W_FreeNameHash(&lumphash);
 
     // Generate hash table
     if (numlumps > 0)
     {
         lumpindex_t     i;
 
-        lumphash = Z_Malloc(sizeof(lumpindex_t) * numlumps, PU_STATIC, NULL);
-
-        for (i = 0; i < numlumps; ++i)
-            lumphash[i] = -1;
+        W_InitNameHash(&lumphash, numlumps);
 
         for (i = 0; i < numlumps; ++i)
         {
-            unsigned int        hash;
-
-            hash = W_LumpNameHash(lumpinfo[i]->name) % numlumps;
+            lumpindex_t *slot = W_NameHashSlot(&lumphash, W_LumpNameKey(lumpinfo[i]->name));
 
-            // Hook into the hash table
-            lumpinfo[i]->next = lumphash[hash];
-            lumphash[hash] = i;
+            // The last lump with a name is found first, and chains to the
+            // ones before it
+            lumpinfo[i]->next = *slot;
+            *slot = i;
         }
     }
 
@@ -55,6 +55,7 @@
 
 #define IWAD 1
 #define PWAD 2
+#define PK3  3
 
 typedef struct lumpinfo_s lumpinfo_t;
 typedef int lumpindex_t;
@@ -67,10 +68,23 @@ struct lumpinfo_s
     int         size;
     void        *cache;
 
-    // Used for hash table lookups
+    // Previous lump with the same name, or -1
     lumpindex_t next;
 };
 
+// open-addressed hash table of 8-character names
+typedef struct
+{
+    uint64_t    key;
+    int         index;
+} namehashentry_t;
+
+typedef struct
+{
+    namehashentry_t *entries;
+    unsigned int    mask;
+} namehash_t;
+
 extern lumpinfo_t       **lumpinfo;
 extern int              numlumps;
 
@@ -90,10 +104,15 @@ void W_ReadLump(lumpindex_t lump, void *dest);
 
 void *W_CacheLumpNum(lumpindex_t lump, int tag);
 void *W_CacheLumpName(char *name, int tag);
+void W_PrecacheLumpNum(lumpindex_t lump, int tag);
 
 void W_GenerateHashTable(void);
 
-extern unsigned int W_LumpNameHash(const char *s);
+uint64_t W_LumpNameKey(const char *name);
+void W_InitNameHash(namehash_t *hash, int count);
+void W_FreeNameHash(namehash_t *hash);
+int *W_NameHashSlot(namehash_t *hash, uint64_t key);
+int W_NameHashFind(const namehash_t *hash, uint64_t key);
 
 void W_ReleaseLumpNum(lumpindex_t lump);
 void W_ReleaseLumpName(char *name);